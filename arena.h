@@ -0,0 +1,72 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Linear allocator for memory that only lives for one frame. Allocations bump
+// a cursor through one block reserved at startup and are all released at once
+// by arena_reset at the top of the frame, so the frame path never touches the
+// heap. Build with -DWORLDS_BELOW_ARENA_DEBUG=ON (ARENA_DEBUG) to log every
+// new peak of per-frame usage.
+#define ARENA_ALIGNMENT 16
+
+typedef struct Arena {
+	uint8_t* base;
+	size_t capacity;
+	size_t used;
+	// highest `used` seen at a reset
+	size_t peak;
+} Arena;
+
+void arena_init(Arena* arena, size_t capacity) {
+	arena->base = malloc(capacity);
+	assert(arena->base != NULL);
+	arena->capacity = capacity;
+	arena->used = 0;
+	arena->peak = 0;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+	size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	// the arena is sized up front; running out means it needs to grow
+	assert(start + size <= arena->capacity);
+	arena->used = start + size;
+	return arena->base + start;
+}
+
+char* arena_printf(Arena* arena, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	char* str = arena_alloc(arena, length + 1);
+	va_start(args, format);
+	vsnprintf(str, length + 1, format, args);
+	va_end(args);
+	return str;
+}
+
+void arena_reset(Arena* arena) {
+	if (arena->used > arena->peak) {
+		arena->peak = arena->used;
+#if defined(ARENA_DEBUG)
+		SDL_Log("Frame arena peak: %zu of %zu bytes", arena->peak, arena->capacity);
+#endif
+	}
+	arena->used = 0;
+}
+
+void arena_free(Arena* arena) {
+	free(arena->base);
+	arena->base = NULL;
+	arena->capacity = 0;
+	arena->used = 0;
+}
+
+#endif // ARENA_H
@@ -0,0 +1,369 @@
+// Microbenchmarks for the component pools and every simulation system.
+//
+//	worlds_below_bench [--populations 1000,10000,...] [--density D] [--repeat R] [--threads N]
+//
+// Pools are timed on add_, get_ and remove_ of `population` entities in one
+// COMPONENT pool. Systems are timed on a world of `population` entities: an
+// oxygenator per two thousand, and half of the rest each characters (health,
+// container, position, dimension, colour, player control) and O2 tanks.
+// Everything is scattered over a square sized so that characters and tanks
+// cover `density` of it, which sets how much the broadphase finds. Each result
+// is the fastest of `repeat` runs on a fresh population, divided by the
+// population.
+//
+// Every result is printed to stdout as one JSON object per line:
+//
+//	{"benchmark": "get_Positions", "backend": "sparse", "population": 1000, "density": 0.100,
+//	 "ns_per_entity": 2.31, "cache_misses_per_entity": 0.02}
+//
+// Cache misses come from perf events on Linux and are null where those are
+// not available.
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <math.h>
+
+#define WORLDS_BELOW_NO_MAIN
+#include "worlds_below.c"
+
+#define BENCH_MAX_POPULATIONS 16
+
+#if defined(ECS_BACKEND_ARCHETYPE)
+#define BENCH_BACKEND "archetype"
+#else
+#define BENCH_BACKEND "sparse"
+#endif
+
+typedef struct Bench {
+	// perf event counting cache misses of this process, or -1
+	int counter;
+	float density;
+	int repeat;
+	uint64_t seed;
+	Uint64 start_ns;
+} Bench;
+
+// the fastest run of one benchmark; `misses` is -1 when not counted
+typedef struct BenchResult {
+	Uint64 ns;
+	int64_t misses;
+} BenchResult;
+
+#define BENCH_RESULT_NONE ((BenchResult) { .ns = UINT64_MAX, .misses = -1 })
+
+// xorshift, so populations are the same on every build
+uint32_t bench_random(Bench* bench) {
+	bench->seed ^= bench->seed << 13;
+	bench->seed ^= bench->seed >> 7;
+	bench->seed ^= bench->seed << 17;
+	return (uint32_t)(bench->seed >> 32);
+}
+
+float bench_random_float(Bench* bench, float range) {
+	return (float)bench_random(bench) / 4294967296.0f * range;
+}
+
+void bench_counter_open(Bench* bench) {
+	bench->counter = -1;
+#if defined(__linux__)
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_MISSES,
+		.disabled = 1,
+		// count the job workers too; they are started after this
+		.inherit = 1,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+	bench->counter = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (bench->counter < 0) {
+		fprintf(stderr, "Cache misses are not available: perf_event_open failed\n");
+	}
+#endif
+}
+
+void bench_start(Bench* bench) {
+#if defined(__linux__)
+	if (bench->counter > -1) {
+		ioctl(bench->counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(bench->counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+	bench->start_ns = SDL_GetTicksNS();
+}
+
+// keeps the run in `best` if it was the fastest so far.
+void bench_stop(Bench* bench, BenchResult* best) {
+	Uint64 ns = SDL_GetTicksNS() - bench->start_ns;
+	int64_t misses = -1;
+#if defined(__linux__)
+	if (bench->counter > -1) {
+		ioctl(bench->counter, PERF_EVENT_IOC_DISABLE, 0);
+		uint64_t count;
+		if (read(bench->counter, &count, sizeof(count)) == sizeof(count)) {
+			misses = (int64_t)count;
+		}
+	}
+#endif
+	if (ns < best->ns) {
+		best->ns = ns;
+		best->misses = misses;
+	}
+}
+
+void bench_report(Bench* bench, const char* name, uint32_t population, BenchResult result) {
+	printf("{\"benchmark\": \"%s\", \"backend\": \"%s\", \"population\": %u, \"density\": %.3f, \"ns_per_entity\": %.2f, ",
+		name, BENCH_BACKEND, population, bench->density, (double)result.ns / population);
+	if (result.misses > -1) {
+		printf("\"cache_misses_per_entity\": %.3f}\n", (double)result.misses / population);
+	} else {
+		printf("\"cache_misses_per_entity\": null}\n");
+	}
+	fflush(stdout);
+}
+
+// the archetype backend keeps every pool in one shared store
+void bench_reset_storage(void) {
+#if defined(ECS_BACKEND_ARCHETYPE)
+	archetype_world_free();
+#endif
+}
+
+// add_, get_ and remove_ over `population` entities, gets and removes in random order.
+void bench_pools(Bench* bench, uint32_t population) {
+	Entity* order = malloc(population * sizeof(Entity));
+	assert(order != NULL);
+	for (uint32_t i = 0; i < population; i++) {
+		order[i] = ENTITY(i, 0);
+	}
+	for (uint32_t i = population - 1; i > 0; i--) {
+		uint32_t j = bench_random(bench) % (i + 1);
+		Entity swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+
+	BenchResult add = BENCH_RESULT_NONE;
+	BenchResult get = BENCH_RESULT_NONE;
+	BenchResult remove = BENCH_RESULT_NONE;
+	volatile float sink = 0;
+	for (int run = 0; run < bench->repeat; run++) {
+		Positions positions = {0};
+
+		bench_start(bench);
+		for (uint32_t i = 0; i < population; i++) {
+			add_Positions(&positions, ENTITY(i, 0), (c_position) { .x = (float)i, .y = 0 });
+		}
+		bench_stop(bench, &add);
+
+		bench_start(bench);
+		float sum = 0;
+		for (uint32_t i = 0; i < population; i++) {
+			sum += get_Positions(&positions, order[i])->x;
+		}
+		bench_stop(bench, &get);
+		sink += sum;
+
+		bench_start(bench);
+		for (uint32_t i = 0; i < population; i++) {
+			remove_Positions(&positions, order[i]);
+		}
+		bench_stop(bench, &remove);
+
+		free_Positions(&positions);
+		bench_reset_storage();
+	}
+	(void)sink;
+	free(order);
+
+	bench_report(bench, "add_Positions", population, add);
+	bench_report(bench, "get_Positions", population, get);
+	bench_report(bench, "remove_Positions", population, remove);
+}
+
+void bench_populate(Bench* bench, World* world, uint32_t population) {
+	const float character_size = 50;
+	const float tank_width = 20;
+	const float tank_height = 40;
+	const float oxygenator_size = 300;
+	uint32_t oxygenator_count = population / 2000 > 0 ? population / 2000 : 1;
+	uint32_t character_count = (population - oxygenator_count) / 2;
+	uint32_t tank_count = population - oxygenator_count - character_count;
+	float covered = character_count * character_size * character_size + tank_count * tank_width * tank_height;
+	float side = sqrtf(covered / bench->density);
+
+	for (uint32_t i = 0; i < character_count; i++) {
+		Entity character = create_entity(&world->entities);
+		add_Positions(&world->positions, character, (c_position) { .x = bench_random_float(bench, side), .y = bench_random_float(bench, side) });
+		add_Dimensions(&world->dimensions, character, (c_dimension) { .width = character_size, .height = character_size });
+		add_Colors(&world->colors, character, (c_color) { .red = 255, .green = 255, .blue = 0 });
+		add_Healths(&world->healths, character, MAX_HEALTH);
+		add_Containers(&world->containers, character, (c_container) { .count = 0 });
+		add_PlayerControlled(&world->player_controlled, character);
+	}
+	for (uint32_t i = 0; i < tank_count; i++) {
+		Entity tank = create_entity(&world->entities);
+		add_Positions(&world->positions, tank, (c_position) { .x = bench_random_float(bench, side), .y = bench_random_float(bench, side) });
+		add_Dimensions(&world->dimensions, tank, (c_dimension) { .width = tank_width, .height = tank_height });
+		add_Containables(&world->containables, tank);
+		add_Sprites(&world->sprites, tank, 0);
+	}
+	for (uint32_t i = 0; i < oxygenator_count; i++) {
+		Entity oxygenator = create_entity(&world->entities);
+		add_Positions(&world->positions, oxygenator, (c_position) { .x = bench_random_float(bench, side), .y = bench_random_float(bench, side) });
+		add_Dimensions(&world->dimensions, oxygenator, (c_dimension) { .width = oxygenator_size, .height = oxygenator_size });
+		add_Oxygenators(&world->oxygenators, oxygenator);
+	}
+}
+
+enum BenchSystem {
+	BENCH_PREVIOUS_POSITION,
+	BENCH_UPDATE_PLAYER,
+	BENCH_OXYGENATORS,
+	BENCH_PICKUPS,
+	BENCH_COMMANDS,
+	BENCH_SOUND,
+	BENCH_COLOR_SNAPSHOT,
+	BENCH_SPRITE_SNAPSHOT,
+	BENCH_HEALTH_SNAPSHOT,
+	BENCH_SYSTEM_COUNT,
+};
+
+const char* bench_system_names[BENCH_SYSTEM_COUNT] = {
+	"sys_position_previous_position",
+	"update_player",
+	"sys_health_oxygenator_position_dimension_sound",
+	"sys_containables_container_position_dimension_sound",
+	"command_buffer_apply",
+	"sys_sound",
+	"sys_position_dimension_color",
+	"sys_position_dimension_sprite",
+	"sys_health_dimension_position",
+};
+
+// Times one call of every system per run, in step order, on a fresh world.
+// sys_position_previous_position is timed on its second call, once every
+// position has its previous position; command_buffer_apply applies what the
+// oxygenator and pickup systems recorded.
+void bench_systems(Bench* bench, JobSystem* jobs, uint32_t population) {
+	BenchResult results[BENCH_SYSTEM_COUNT];
+	for (int i = 0; i < BENCH_SYSTEM_COUNT; i++) {
+		results[i] = BENCH_RESULT_NONE;
+	}
+	static World world;
+	static RenderSnapshot snapshot;
+	long step = NANO_SECONDS_PER_SECOND / SIMULATION_HZ;
+	for (int run = 0; run < bench->repeat; run++) {
+		world_init(&world, jobs);
+		bench_populate(bench, &world, population);
+		sys_position_previous_position(&world.commands, WRITER_PREVIOUS_POSITIONS, &world.positions, &world.previous_positions);
+		command_buffer_apply(&world.commands, &world.entities);
+
+		for (int system = 0; system < BENCH_SYSTEM_COUNT; system++) {
+			bench_start(bench);
+			switch (system) {
+			case BENCH_PREVIOUS_POSITION:
+				sys_position_previous_position(&world.commands, WRITER_PREVIOUS_POSITIONS, &world.positions, &world.previous_positions);
+				break;
+			case BENCH_UPDATE_PLAYER:
+				update_player(&step, &world.player_controlled, &world.positions, false, true, false, true);
+				break;
+			case BENCH_OXYGENATORS:
+				sys_health_oxygenator_position_dimension_sound(jobs, 0, &world.commands, WRITER_OXYGENATORS, &step, &world.oxygenator_grid, &world.occupied_oxygenators, &world.healths, &world.oxygenators, &world.positions, &world.dimensions, &world.sounds);
+				break;
+			case BENCH_PICKUPS:
+				sys_containables_container_position_dimension_sound(jobs, 0, &world.commands, WRITER_PICKUPS, &world.containable_grid, &world.pickup_candidates, &world.containables, &world.containers, &world.positions, &world.dimensions, &world.sounds);
+				break;
+			case BENCH_COMMANDS:
+				command_buffer_apply(&world.commands, &world.entities);
+				break;
+			case BENCH_SOUND:
+				sys_sound(&world.sounds);
+				break;
+			case BENCH_COLOR_SNAPSHOT:
+				sys_position_dimension_color(&world.positions, &world.previous_positions, &world.dimensions, &world.colors, &snapshot);
+				break;
+			case BENCH_SPRITE_SNAPSHOT:
+				sys_position_dimension_sprite(&world.positions, &world.previous_positions, &world.dimensions, &world.sprites, &snapshot);
+				break;
+			case BENCH_HEALTH_SNAPSHOT:
+				sys_health_dimension_position(&world.healths, &world.positions, &world.previous_positions, &world.dimensions, &snapshot);
+				break;
+			}
+			bench_stop(bench, &results[system]);
+		}
+		world_free(&world);
+	}
+	free(snapshot.colors);
+	free(snapshot.sprites);
+	free(snapshot.healths);
+	memset(&snapshot, 0, sizeof(snapshot));
+	for (int system = 0; system < BENCH_SYSTEM_COUNT; system++) {
+		bench_report(bench, bench_system_names[system], population, results[system]);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Bench bench = { .density = 0.1f, .repeat = 5, .seed = 0x9E3779B97F4A7C15ull };
+	uint32_t populations[BENCH_MAX_POPULATIONS] = { 1000, 10000, 100000, 1000000 };
+	int population_count = 4;
+	int worker_count = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--populations") == 0 && i + 1 < argc) {
+			population_count = 0;
+			for (char* item = strtok(argv[++i], ","); item != NULL && population_count < BENCH_MAX_POPULATIONS; item = strtok(NULL, ",")) {
+				populations[population_count++] = (uint32_t)atol(item);
+			}
+		} else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc) {
+			bench.density = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			bench.repeat = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			worker_count = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (bench.density <= 0 || bench.repeat < 1) {
+		fprintf(stderr, "--density and --repeat must be positive\n");
+		return 1;
+	}
+	for (int i = 0; i < population_count; i++) {
+		if (populations[i] < 3 || populations[i] > MAX_ENTITY_COUNT) {
+			fprintf(stderr, "Populations must be between 3 and %d entities, not %u\n", MAX_ENTITY_COUNT, populations[i]);
+			return 1;
+		}
+	}
+
+	if (!SDL_Init(0)) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n", SDL_GetError());
+		return 1;
+	}
+	bench_counter_open(&bench);
+	if (worker_count < 1) {
+		worker_count = SDL_GetNumLogicalCPUCores();
+	}
+	static JobSystem jobs;
+	if (!job_system_init(&jobs, worker_count - 1)) {
+		return 1;
+	}
+	for (int i = 0; i < population_count; i++) {
+		fprintf(stderr, "Population %u...\n", populations[i]);
+		bench_pools(&bench, populations[i]);
+		bench_systems(&bench, &jobs, populations[i]);
+	}
+	job_system_free(&jobs);
+#if defined(__linux__)
+	if (bench.counter > -1) {
+		close(bench.counter);
+	}
+#endif
+	SDL_Quit();
+	return 0;
+}
@@ -1,46 +1,472 @@
 #ifndef ECS_H
 #define ECS_H
 
+#include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+// An Entity is a handle: the low ENTITY_INDEX_BITS select a slot and the bits
+// above hold that slot's generation, which is bumped every time the slot is
+// recycled. Handles stay non-negative so -1 can keep meaning "no entity".
 typedef int32_t Entity;
-#define MAX_ENTITY_COUNT 1000
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_GENERATION_BITS 11
+#define ENTITY_INDEX_MASK ((1 << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GENERATION_MASK ((1 << ENTITY_GENERATION_BITS) - 1)
+#define MAX_ENTITY_COUNT (1 << ENTITY_INDEX_BITS)
+#define NULL_ENTITY ((Entity)-1)
 
-// TODO: Make a static "garbage_bin" of deleted entity Ids that can be reused.
-// Debug assertions should frequently check to ensure that entities are not
-// "leaking" components.
+#define ENTITY_INDEX(e) ((e) & ENTITY_INDEX_MASK)
+#define ENTITY_GENERATION(e) (((e) >> ENTITY_INDEX_BITS) & ENTITY_GENERATION_MASK)
+#define ENTITY(index, generation) ((Entity)((((generation) & ENTITY_GENERATION_MASK) << ENTITY_INDEX_BITS) | (index)))
 
+// TODO: Debug assertions should frequently check to ensure that entities are
+// not "leaking" components when they are destroyed.
+
+// Entity allocator. Destroyed slots go on a free list and are handed out again
+// (most recently freed first, so the sparse indices stay compact) with their
+// generation bumped, which makes any handle to the old occupant stale.
+typedef struct Entities {
+	uint16_t* generations;
+	Entity* free_list;
+	Entity free_count;
+	Entity capacity;
+	Entity next_index;
+	Entity count;
+} Entities;
+
+Entity create_entity(Entities* entities) {
+	Entity index;
+	if (entities->free_count > 0) {
+		index = entities->free_list[--entities->free_count];
+	} else {
+		assert(entities->next_index < MAX_ENTITY_COUNT);
+		if (entities->next_index == entities->capacity) {
+			Entity capacity = entities->capacity ? entities->capacity * 2 : 64;
+			entities->generations = realloc(entities->generations, capacity * sizeof(uint16_t));
+			entities->free_list = realloc(entities->free_list, capacity * sizeof(Entity));
+			assert(entities->generations != NULL && entities->free_list != NULL);
+			entities->capacity = capacity;
+		}
+		index = entities->next_index++;
+		entities->generations[index] = 0;
+	}
+	entities->count++;
+	return ENTITY(index, entities->generations[index]);
+}
+
+bool entity_alive(const Entities* entities, Entity e) {
+	Entity index = ENTITY_INDEX(e);
+	return e > -1 &&
+		index < entities->next_index &&
+		entities->generations[index] == ENTITY_GENERATION(e);
+}
+
+// returns the live handle currently occupying slot `index`.
+Entity entity_at(const Entities* entities, Entity index) {
+	return ENTITY(index, entities->generations[index]);
+}
+
+// Components are not removed here; callers strip them from their pools first.
+void destroy_entity(Entities* entities, Entity e) {
+	if (!entity_alive(entities, e)) {
+		return;
+	}
+	Entity index = ENTITY_INDEX(e);
+	entities->generations[index] = (entities->generations[index] + 1) & ENTITY_GENERATION_MASK;
+	entities->free_list[entities->free_count++] = index;
+	entities->count--;
+}
+
+void free_entities(Entities* entities) {
+	free(entities->generations);
+	free(entities->free_list);
+	memset(entities, 0, sizeof(*entities));
+}
+
+#include "ecs_commands.h"
+
+// Queries join several pools and yield every entity that has all of them, with
+// `components[i]` pointing at the matched entity's data in the i-th pool, in
+// the order the pools were passed:
+//
+//	Query q = QUERY(colors, positions, dimensions);
+//	while (query_next(&q)) {
+//		c_color* p_color = q.components[0];
+//		...
+//	}
+//
+// Adding or removing components of the queried pools while iterating may skip
+// or revisit entities for that pass, and may move the components of the
+// entity being changed.
+//
+// A query can also be split by rows to spread one pass over several threads.
+// query_row_count gives the number of rows the query walks; every thread then
+// creates the same query and limits it to its own range of them:
+//
+//	Query q = QUERY(healths, positions);
+//	query_limit(&q, begin, end);
+//
+// Row ranges only line up between queries while no pool changes size, and
+// the pools must not change at all while the threads iterate.
+#define QUERY_MAX_COMPONENTS 8
+#define QUERY(...) query_init(sizeof((void*[]){ __VA_ARGS__ }) / sizeof(void*), (void*[]){ __VA_ARGS__ })
+
+// Two storage backends sit behind COMPONENT and QUERY. The default keeps every
+// pool in its own sparse set. Defining ECS_BACKEND_ARCHETYPE (the
+// WORLDS_BELOW_ARCHETYPES CMake option) instead groups entities with the same
+// set of components into archetype chunks, see ecs_archetype.h.
+#if defined(ECS_BACKEND_ARCHETYPE)
+#include "ecs_archetype.h"
+#else
+
+// Component pools are paged sparse sets. The sparse `entity_index` is split
+// into pages of ENTITY_PAGE_SIZE slots which are only allocated once an entity
+// in that range gains the component, and the dense `data`/`entities` arrays
+// double as they fill. A pool holding a single entity costs a few cache lines
+// no matter how large the entity ids get. Pages are keyed by ENTITY_INDEX while
+// the dense `entities` keep the full handle, so a stale handle whose slot has
+// been recycled fails the membership check in O(1).
+//
+// A `borrowed` set points into memory it does not own, such as a mapped
+// snapshot (snapshot.h): only its page table is its own. Writes in place are
+// fine; anything that would reallocate or free an array first copies the set
+// to the heap with entity_set_own.
+#define ENTITY_PAGE_BITS 10
+#define ENTITY_PAGE_SIZE (1 << ENTITY_PAGE_BITS)
+#define ENTITY_PAGE_MASK (ENTITY_PAGE_SIZE - 1)
+#define COMPONENT_MIN_CAPACITY 8
+
+#define ENTITY_SET_FIELDS							\
+	Entity* entities;							\
+	Entity** entity_index;							\
+	Entity count;								\
+	Entity capacity;							\
+	Entity page_count;							\
+	size_t stride;								\
+	uint64_t* bits;								\
+	Entity word_count;							\
+	bool borrowed;
+
+// The type-erased view of every component pool. The COMPONENT macro overlays
+// it with a typed `data` pointer so the paging logic and queries live here
+// once instead of being expanded for every component type.
+typedef struct EntitySet {
+	void* data;
+	ENTITY_SET_FIELDS
+} EntitySet;
+
+// returns the dense index of `e` or -1 when the set does not contain it.
+Entity entity_set_find(const EntitySet* set, Entity e) {
+	if (set->bits != NULL) {
+		// most probes of a tag miss, and a clear bit settles those
+		Entity index = ENTITY_INDEX(e);
+		if (e < 0 || (index >> 6) >= set->word_count || !((set->bits[index >> 6] >> (index & 63)) & 1)) {
+			return -1;
+		}
+	}
+	Entity page = ENTITY_INDEX(e) >> ENTITY_PAGE_BITS;
+	if (e < 0 || page >= set->page_count || set->entity_index[page] == NULL) {
+		return -1;
+	}
+	Entity idx = set->entity_index[page][ENTITY_INDEX(e) & ENTITY_PAGE_MASK];
+	if (idx < set->count && idx > -1 && set->entities[idx] == e) {
+		return idx;
+	}
+	return -1;
+}
+
+void* entity_set_copy(const void* source, size_t size) {
+	if (source == NULL || size == 0) {
+		return NULL;
+	}
+	void* copy = malloc(size);
+	assert(copy != NULL);
+	memcpy(copy, source, size);
+	return copy;
+}
+
+// moves a borrowed set's arrays to the heap, so they can be reallocated and freed.
+void entity_set_own(EntitySet* set) {
+	if (!set->borrowed) {
+		return;
+	}
+	set->entities = entity_set_copy(set->entities, set->capacity * sizeof(Entity));
+	set->data = entity_set_copy(set->data, set->capacity * set->stride);
+	set->bits = entity_set_copy(set->bits, set->word_count * sizeof(uint64_t));
+	for (Entity page = 0; page < set->page_count; page++) {
+		set->entity_index[page] = entity_set_copy(set->entity_index[page], ENTITY_PAGE_SIZE * sizeof(Entity));
+	}
+	set->borrowed = false;
+}
+
+// returns the sparse slot for `e`, allocating its page on first use.
+Entity* entity_set_slot(EntitySet* set, Entity e) {
+	assert(e > -1);
+	Entity page = ENTITY_INDEX(e) >> ENTITY_PAGE_BITS;
+	if (page >= set->page_count) {
+		Entity page_count = set->page_count ? set->page_count * 2 : 1;
+		while (page_count <= page) {
+			page_count *= 2;
+		}
+		set->entity_index = realloc(set->entity_index, page_count * sizeof(Entity*));
+		assert(set->entity_index != NULL);
+		memset(set->entity_index + set->page_count, 0, (page_count - set->page_count) * sizeof(Entity*));
+		set->page_count = page_count;
+	}
+	if (set->entity_index[page] == NULL) {
+		entity_set_own(set);
+		set->entity_index[page] = malloc(ENTITY_PAGE_SIZE * sizeof(Entity));
+		assert(set->entity_index[page] != NULL);
+		// all bits set is -1 for every slot
+		memset(set->entity_index[page], 0xFF, ENTITY_PAGE_SIZE * sizeof(Entity));
+	}
+	return &set->entity_index[page][ENTITY_INDEX(e) & ENTITY_PAGE_MASK];
+}
+
+// grows the dense arrays geometrically.
+void entity_set_grow(EntitySet* set, size_t stride) {
+	entity_set_own(set);
+	Entity capacity = set->capacity ? set->capacity * 2 : COMPONENT_MIN_CAPACITY;
+	set->entities = realloc(set->entities, capacity * sizeof(Entity));
+	set->data = realloc(set->data, capacity * stride);
+	assert(set->entities != NULL && set->data != NULL);
+	set->capacity = capacity;
+	set->stride = stride;
+}
+
+// moves the last dense entity into `idx`. The caller moves the data the same way.
+void entity_set_swap_remove(EntitySet* set, Entity idx) {
+	Entity removed = set->entities[idx];
+	Entity last_entity = set->entities[set->count - 1];
+	set->entities[idx] = last_entity;
+	*entity_set_slot(set, last_entity) = idx;
+	*entity_set_slot(set, removed) = -1;
+	set->count--;
+}
+
+void entity_set_free(EntitySet* set) {
+	if (!set->borrowed) {
+		for (Entity page = 0; page < set->page_count; page++) {
+			free(set->entity_index[page]);
+		}
+		free(set->entities);
+		free(set->data);
+		free(set->bits);
+	}
+	free(set->entity_index);
+	memset(set, 0, sizeof(*set));
+}
+
+// Tags are data-less components. A bitset over ENTITY_INDEX settles most
+// membership tests with a shift and a mask and lets tags be intersected a
+// word at a time; a set bit is confirmed against the member's full handle
+// through the same sparse pages components use, so a stale handle is not a
+// member. Removal swaps the last member into the gap, like components, so the
+// set never needs compacting and queries only read it.
+bool tag_set_has(const EntitySet* set, Entity e) {
+	return entity_set_find(set, e) > -1;
+}
+
+void tag_set_remove(EntitySet* set, Entity e) {
+	Entity idx = entity_set_find(set, e);
+	if (idx < 0) {
+		return;
+	}
+	Entity index = ENTITY_INDEX(e);
+	set->bits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+	entity_set_swap_remove(set, idx);
+}
+
+void tag_set_add(EntitySet* set, Entity e) {
+	assert(e > -1);
+	if (tag_set_has(set, e)) {
+		return;
+	}
+	Entity index = ENTITY_INDEX(e);
+	Entity word = index >> 6;
+	if (word >= set->word_count) {
+		Entity word_count = set->word_count ? set->word_count * 2 : 1;
+		while (word_count <= word) {
+			word_count *= 2;
+		}
+		entity_set_own(set);
+		set->bits = realloc(set->bits, word_count * sizeof(uint64_t));
+		assert(set->bits != NULL);
+		memset(set->bits + set->word_count, 0, (word_count - set->word_count) * sizeof(uint64_t));
+		set->word_count = word_count;
+	}
+	uint64_t bit = (uint64_t)1 << (index & 63);
+	if (set->bits[word] & bit) {
+		// the slot's previous occupant was destroyed without losing the tag
+		Entity* p_slot = entity_set_slot(set, e);
+		entity_set_swap_remove(set, *p_slot);
+	}
+	set->bits[word] |= bit;
+	if (set->count == set->capacity) {
+		entity_set_own(set);
+		set->capacity = set->capacity ? set->capacity * 2 : COMPONENT_MIN_CAPACITY;
+		set->entities = realloc(set->entities, set->capacity * sizeof(Entity));
+		assert(set->entities != NULL);
+	}
+	*entity_set_slot(set, e) = set->count;
+	set->entities[set->count] = e;
+	set->count++;
+}
+
+// counts the slots present in both tags a word at a time.
+Entity tag_set_intersection_count(const EntitySet* a, const EntitySet* b) {
+	Entity words = a->word_count < b->word_count ? a->word_count : b->word_count;
+	Entity count = 0;
+	for (Entity word = 0; word < words; word++) {
+		count += __builtin_popcountll(a->bits[word] & b->bits[word]);
+	}
+	return count;
+}
+
+// Sparse set queries are driven by whichever pool has the fewest entities when
+// the query is created; every other pool is probed once per candidate.
+typedef struct Query {
+	EntitySet* sets[QUERY_MAX_COMPONENTS];
+	void* components[QUERY_MAX_COMPONENTS];
+	EntitySet* driver;
+	int set_count;
+	Entity cursor;
+	// rows left to walk, see query_limit
+	Entity remaining;
+	Entity entity;
+} Query;
+
+// `pools` are pointers to COMPONENT pools, whose first member is their EntitySet.
+Query query_init(int pool_count, void* pools[]) {
+	assert(pool_count > 0 && pool_count <= QUERY_MAX_COMPONENTS);
+	Query q = { .set_count = pool_count, .remaining = INT32_MAX, .entity = NULL_ENTITY };
+	for (int i = 0; i < pool_count; i++) {
+		q.sets[i] = pools[i];
+		if (q.driver == NULL || q.sets[i]->count < q.driver->count) {
+			q.driver = q.sets[i];
+		}
+	}
+	return q;
+}
+
+// rows are the dense entries of the driving pool.
+Entity query_row_count(const Query* q) {
+	return q->driver->count;
+}
+
+// restricts the query to rows [begin, end).
+void query_limit(Query* q, Entity begin, Entity end) {
+	q->cursor = begin;
+	q->remaining = end - begin;
+}
+
+bool query_next(Query* q) {
+	while (q->remaining > 0 && q->cursor < q->driver->count) {
+		Entity row = q->cursor++;
+		q->remaining--;
+		Entity e = q->driver->entities[row];
+		bool matched = true;
+		for (int i = 0; i < q->set_count && matched; i++) {
+			EntitySet* set = q->sets[i];
+			Entity idx = set == q->driver ? row : entity_set_find(set, e);
+			if (idx < 0) {
+				matched = false;
+			} else {
+				// tags have no data
+				q->components[i] = set->data ? (char*)set->data + (size_t)idx * set->stride : NULL;
+			}
+		}
+		if (matched) {
+			q->entity = e;
+			return true;
+		}
+	}
+	return false;
+}
+
+// A zero-initialised pool (`Positions positions = {0};`) is empty and ready to use.
 #define COMPONENT(ComponentName, DataType)					\
 typedef struct {								\
-	DataType data[MAX_ENTITY_COUNT];					\
-	Entity entities[MAX_ENTITY_COUNT];					\
-	Entity entity_index[MAX_ENTITY_COUNT];				\
-	Entity count;								\
+	union {									\
+		EntitySet set;							\
+		struct {							\
+			DataType* data;						\
+			ENTITY_SET_FIELDS					\
+		};								\
+	};									\
 } ComponentName;								\
 										\
 void add_##ComponentName(ComponentName* comp, Entity e, DataType value) { 	\
-	comp->entity_index[e] = comp->count;					\
+	Entity idx = entity_set_find(&comp->set, e);				\
+	if (idx > -1) {								\
+		comp->data[idx] = value;					\
+		return;								\
+	}									\
+	if (comp->count == comp->capacity) {					\
+		entity_set_grow(&comp->set, sizeof(DataType));			\
+	}									\
+	*entity_set_slot(&comp->set, e) = comp->count;				\
 	comp->data[comp->count] = value;					\
 	comp->entities[comp->count] = e;					\
 	comp->count++;								\
 }										\
 										\
 DataType* get_##ComponentName(ComponentName* comp, Entity e) {			\
-	Entity idx = comp->entity_index[e];					\
-	if (idx < comp->count && idx > -1 && comp->entities[idx] == e) {	\
+	Entity idx = entity_set_find(&comp->set, e);				\
+	if (idx > -1) {								\
 		return &comp->data[idx];					\
 	}									\
 	return NULL;								\
 }										\
 										\
 void remove_##ComponentName(ComponentName* comp, Entity e) {			\
-    	size_t idx = comp->entity_index[e];                                     \
-    	size_t last_idx = comp->count - 1;                                      \
-	comp->data[idx] = comp->data[last_idx];                         	\
-	Entity last_entity = comp->entities[last_idx];                  	\
-	comp->entities[idx] = last_entity;                              	\
-	comp->entity_index[last_entity] = idx;                          	\
-	comp->count--;                                                          \
-}
+	Entity idx = entity_set_find(&comp->set, e);				\
+	if (idx < 0) {								\
+		return;								\
+	}									\
+	comp->data[idx] = comp->data[comp->count - 1];				\
+	entity_set_swap_remove(&comp->set, idx);				\
+}										\
+										\
+void free_##ComponentName(ComponentName* comp) {				\
+	entity_set_free(&comp->set);						\
+}										\
+										\
+COMPONENT_COMMANDS(ComponentName, DataType)
+
+// A tag carries no data: `add_Tag(tag, e)`, `has_Tag(tag, e)`, `remove_Tag(tag, e)`.
+#define TAG_COMPONENT(TagName)							\
+typedef struct {								\
+	union {									\
+		EntitySet set;							\
+		struct {							\
+			void* data;						\
+			ENTITY_SET_FIELDS					\
+		};								\
+	};									\
+} TagName;									\
+										\
+void add_##TagName(TagName* tag, Entity e) {					\
+	tag_set_add(&tag->set, e);						\
+}										\
+										\
+bool has_##TagName(TagName* tag, Entity e) {					\
+	return tag_set_has(&tag->set, e);					\
+}										\
+										\
+void remove_##TagName(TagName* tag, Entity e) {					\
+	tag_set_remove(&tag->set, e);						\
+}										\
+										\
+void free_##TagName(TagName* tag) {						\
+	entity_set_free(&tag->set);						\
+}										\
+										\
+TAG_COMPONENT_COMMANDS(TagName)
+
+#endif // ECS_BACKEND_ARCHETYPE
 
 #endif // ECS_H
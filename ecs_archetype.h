@@ -0,0 +1,442 @@
+#ifndef ECS_ARCHETYPE_H
+#define ECS_ARCHETYPE_H
+
+// Archetype storage backend, included by ecs.h when ECS_BACKEND_ARCHETYPE is
+// defined. Every entity lives in exactly one archetype: the table for its
+// exact set of components. An archetype stores its rows in fixed size chunks
+// holding one column per component, so systems that join Position, Dimension
+// and Color stream through adjacent memory instead of probing three pools.
+//
+// Component pools become handles into one shared world. A pool registers its
+// component on first use, so a zero-initialised pool still works. Adding or
+// removing a component moves the entity's row to another archetype, which
+// invalidates pointers previously returned for that entity.
+#define ARCHETYPE_CHUNK_SIZE (16 * 1024)
+#define ARCHETYPE_MAX_COMPONENTS 64
+#define ARCHETYPE_COLUMN_ALIGN 16
+
+typedef uint64_t ComponentMask;
+
+typedef struct Archetype {
+	ComponentMask mask;
+	int column_count;
+	// column holding each component id, or -1
+	int8_t column_of[ARCHETYPE_MAX_COMPONENTS];
+	int column_component[ARCHETYPE_MAX_COMPONENTS];
+	size_t column_offset[ARCHETYPE_MAX_COMPONENTS];
+	// every chunk starts with the Entity column; all but the last are full
+	Entity rows_per_chunk;
+	unsigned char** chunks;
+	int chunk_count;
+	int chunk_capacity;
+	Entity count;
+} Archetype;
+
+typedef struct ArchetypeRecord {
+	Entity entity;
+	int archetype;
+	Entity row;
+} ArchetypeRecord;
+
+// The part of every pool that queries read. `id` is one based so that a
+// zeroed pool reads as unregistered.
+typedef struct ArchetypePool {
+	int id;
+	Entity count;
+} ArchetypePool;
+
+typedef struct ArchetypeWorld {
+	size_t component_size[ARCHETYPE_MAX_COMPONENTS];
+	// the pool of each component, whose count follows the rows carrying it
+	ArchetypePool* pools[ARCHETYPE_MAX_COMPONENTS];
+	int component_count;
+	Archetype* archetypes;
+	int archetype_count;
+	int archetype_capacity;
+	// indexed by ENTITY_INDEX
+	ArchetypeRecord* records;
+	Entity record_capacity;
+} ArchetypeWorld;
+
+ArchetypeWorld archetype_world;
+
+int archetype_register(ArchetypePool* pool, size_t size) {
+	assert(archetype_world.component_count < ARCHETYPE_MAX_COMPONENTS);
+	int component = archetype_world.component_count++;
+	archetype_world.component_size[component] = size;
+	archetype_world.pools[component] = pool;
+	return component + 1;
+}
+
+// counts a row entering or leaving `a` against every pool it has a column of.
+void archetype_count_row(Archetype* a, Entity delta) {
+	for (int column = 0; column < a->column_count; column++) {
+		archetype_world.pools[a->column_component[column]]->count += delta;
+	}
+}
+
+Entity* archetype_entity(Archetype* a, Entity row) {
+	return (Entity*)a->chunks[row / a->rows_per_chunk] + row % a->rows_per_chunk;
+}
+
+void* archetype_component(Archetype* a, int column, Entity row) {
+	size_t size = archetype_world.component_size[a->column_component[column]];
+	return a->chunks[row / a->rows_per_chunk] + a->column_offset[column] + (size_t)(row % a->rows_per_chunk) * size;
+}
+
+int archetype_find_or_create(ComponentMask mask) {
+	ArchetypeWorld* world = &archetype_world;
+	for (int i = 0; i < world->archetype_count; i++) {
+		if (world->archetypes[i].mask == mask) {
+			return i;
+		}
+	}
+	if (world->archetype_count == world->archetype_capacity) {
+		int capacity = world->archetype_capacity ? world->archetype_capacity * 2 : 16;
+		world->archetypes = realloc(world->archetypes, capacity * sizeof(Archetype));
+		assert(world->archetypes != NULL);
+		world->archetype_capacity = capacity;
+	}
+	Archetype* a = &world->archetypes[world->archetype_count];
+	memset(a, 0, sizeof(*a));
+	memset(a->column_of, -1, sizeof(a->column_of));
+	a->mask = mask;
+
+	size_t row_size = sizeof(Entity);
+	for (int component = 0; component < ARCHETYPE_MAX_COMPONENTS; component++) {
+		if (mask & ((ComponentMask)1 << component)) {
+			a->column_of[component] = a->column_count;
+			a->column_component[a->column_count++] = component;
+			row_size += world->component_size[component];
+		}
+	}
+	// leave room for padding every column up to the alignment
+	size_t padding = (size_t)a->column_count * ARCHETYPE_COLUMN_ALIGN;
+	a->rows_per_chunk = (ARCHETYPE_CHUNK_SIZE - padding) / row_size;
+	assert(a->rows_per_chunk > 0);
+	size_t offset = a->rows_per_chunk * sizeof(Entity);
+	for (int column = 0; column < a->column_count; column++) {
+		offset = (offset + ARCHETYPE_COLUMN_ALIGN - 1) & ~(size_t)(ARCHETYPE_COLUMN_ALIGN - 1);
+		a->column_offset[column] = offset;
+		offset += a->rows_per_chunk * world->component_size[a->column_component[column]];
+	}
+	assert(offset <= ARCHETYPE_CHUNK_SIZE);
+	return world->archetype_count++;
+}
+
+Entity archetype_push(Archetype* a, Entity e) {
+	if (a->count == a->chunk_count * a->rows_per_chunk) {
+		if (a->chunk_count == a->chunk_capacity) {
+			a->chunk_capacity = a->chunk_capacity ? a->chunk_capacity * 2 : 4;
+			a->chunks = realloc(a->chunks, a->chunk_capacity * sizeof(unsigned char*));
+			assert(a->chunks != NULL);
+		}
+		a->chunks[a->chunk_count] = malloc(ARCHETYPE_CHUNK_SIZE);
+		assert(a->chunks[a->chunk_count] != NULL);
+		a->chunk_count++;
+	}
+	Entity row = a->count++;
+	*archetype_entity(a, row) = e;
+	archetype_count_row(a, 1);
+	return row;
+}
+
+// moves the last row into `row` and fixes up the moved entity's record.
+void archetype_pop_row(Archetype* a, Entity row) {
+	Entity last = a->count - 1;
+	if (row != last) {
+		Entity moved = *archetype_entity(a, last);
+		*archetype_entity(a, row) = moved;
+		for (int column = 0; column < a->column_count; column++) {
+			size_t size = archetype_world.component_size[a->column_component[column]];
+			memcpy(archetype_component(a, column, row), archetype_component(a, column, last), size);
+		}
+		archetype_world.records[ENTITY_INDEX(moved)].row = row;
+	}
+	a->count--;
+	archetype_count_row(a, -1);
+}
+
+ArchetypeRecord* archetype_record(Entity e) {
+	ArchetypeWorld* world = &archetype_world;
+	Entity index = ENTITY_INDEX(e);
+	if (index >= world->record_capacity) {
+		Entity capacity = world->record_capacity ? world->record_capacity : 64;
+		while (capacity <= index) {
+			capacity *= 2;
+		}
+		world->records = realloc(world->records, capacity * sizeof(ArchetypeRecord));
+		assert(world->records != NULL);
+		for (Entity i = world->record_capacity; i < capacity; i++) {
+			world->records[i] = (ArchetypeRecord) { .entity = NULL_ENTITY, .archetype = -1 };
+		}
+		world->record_capacity = capacity;
+	}
+	return &world->records[index];
+}
+
+// returns the live record of `e`, or NULL when it has no components.
+ArchetypeRecord* archetype_find(Entity e) {
+	if (e < 0 || ENTITY_INDEX(e) >= archetype_world.record_capacity) {
+		return NULL;
+	}
+	ArchetypeRecord* record = &archetype_world.records[ENTITY_INDEX(e)];
+	if (record->entity != e || record->archetype < 0) {
+		return NULL;
+	}
+	return record;
+}
+
+// moves the entity behind `record` into the archetype for `mask`, carrying
+// over every component both archetypes share.
+void archetype_move(ArchetypeRecord* record, ComponentMask mask) {
+	int src = record->archetype;
+	if (mask == 0) {
+		archetype_pop_row(&archetype_world.archetypes[src], record->row);
+		record->archetype = -1;
+		return;
+	}
+	int dst = archetype_find_or_create(mask);
+	Archetype* to = &archetype_world.archetypes[dst];
+	Entity row = archetype_push(to, record->entity);
+	if (src > -1) {
+		Archetype* from = &archetype_world.archetypes[src];
+		for (int column = 0; column < to->column_count; column++) {
+			int component = to->column_component[column];
+			int from_column = from->column_of[component];
+			if (from_column > -1) {
+				memcpy(archetype_component(to, column, row), archetype_component(from, from_column, record->row), archetype_world.component_size[component]);
+			}
+		}
+		archetype_pop_row(from, record->row);
+	}
+	record->archetype = dst;
+	record->row = row;
+}
+
+// returns true when the entity did not have the component yet.
+bool archetype_add(int id, Entity e, const void* value) {
+	int component = id - 1;
+	ComponentMask bit = (ComponentMask)1 << component;
+	ArchetypeRecord* record = archetype_find(e);
+	ComponentMask mask = 0;
+	if (record == NULL) {
+		record = archetype_record(e);
+		if (record->archetype > -1) {
+			// a destroyed entity that kept its components; drop its row
+			archetype_move(record, 0);
+		}
+		record->entity = e;
+	} else {
+		mask = archetype_world.archetypes[record->archetype].mask;
+	}
+	bool added = !(mask & bit);
+	if (added) {
+		archetype_move(record, mask | bit);
+	}
+	Archetype* a = &archetype_world.archetypes[record->archetype];
+	if (archetype_world.component_size[component] > 0) {
+		memcpy(archetype_component(a, a->column_of[component], record->row), value, archetype_world.component_size[component]);
+	}
+	return added;
+}
+
+void* archetype_get(int id, Entity e) {
+	ArchetypeRecord* record = archetype_find(e);
+	if (id == 0 || record == NULL) {
+		return NULL;
+	}
+	Archetype* a = &archetype_world.archetypes[record->archetype];
+	int column = a->column_of[id - 1];
+	if (column < 0) {
+		return NULL;
+	}
+	return archetype_component(a, column, record->row);
+}
+
+// returns true when the entity had the component.
+bool archetype_remove(int id, Entity e) {
+	ArchetypeRecord* record = archetype_find(e);
+	if (id == 0 || record == NULL) {
+		return false;
+	}
+	ComponentMask bit = (ComponentMask)1 << (id - 1);
+	ComponentMask mask = archetype_world.archetypes[record->archetype].mask;
+	if (!(mask & bit)) {
+		return false;
+	}
+	archetype_move(record, mask & ~bit);
+	return true;
+}
+
+// removes the component from every entity that has it.
+void archetype_strip(int id) {
+	if (id == 0) {
+		return;
+	}
+	ComponentMask bit = (ComponentMask)1 << (id - 1);
+	for (int i = 0; i < archetype_world.archetype_count; i++) {
+		while ((archetype_world.archetypes[i].mask & bit) && archetype_world.archetypes[i].count > 0) {
+			Archetype* a = &archetype_world.archetypes[i];
+			archetype_remove(id, *archetype_entity(a, a->count - 1));
+		}
+	}
+}
+
+void archetype_world_free(void) {
+	ArchetypeWorld* world = &archetype_world;
+	for (int i = 0; i < world->archetype_count; i++) {
+		for (int chunk = 0; chunk < world->archetypes[i].chunk_count; chunk++) {
+			free(world->archetypes[i].chunks[chunk]);
+		}
+		free(world->archetypes[i].chunks);
+	}
+	free(world->archetypes);
+	free(world->records);
+	memset(world, 0, sizeof(*world));
+}
+
+// Archetype queries visit every archetype containing all queried components,
+// chunk by chunk.
+typedef struct Query {
+	void* components[QUERY_MAX_COMPONENTS];
+	int component[QUERY_MAX_COMPONENTS];
+	int set_count;
+	ComponentMask mask;
+	int archetype;
+	Entity row;
+	// rows left to walk, see query_limit
+	Entity remaining;
+	Entity entity;
+} Query;
+
+// `pools` are pointers to COMPONENT pools, whose first member is their ArchetypePool.
+Query query_init(int pool_count, void* pools[]) {
+	assert(pool_count > 0 && pool_count <= QUERY_MAX_COMPONENTS);
+	Query q = { .set_count = pool_count, .remaining = INT32_MAX, .entity = NULL_ENTITY };
+	for (int i = 0; i < pool_count; i++) {
+		ArchetypePool* pool = pools[i];
+		if (pool->id == 0) {
+			// never used, so no entity can match
+			q.archetype = INT32_MAX;
+			return q;
+		}
+		q.component[i] = pool->id - 1;
+		q.mask |= (ComponentMask)1 << q.component[i];
+	}
+	return q;
+}
+
+// rows are those of every matching archetype, in archetype order.
+Entity query_row_count(const Query* q) {
+	Entity count = 0;
+	for (int i = q->archetype; i < archetype_world.archetype_count; i++) {
+		Archetype* a = &archetype_world.archetypes[i];
+		if ((a->mask & q->mask) == q->mask) {
+			count += a->count;
+		}
+	}
+	return count;
+}
+
+// restricts the query to rows [begin, end), skipping whole archetypes to reach `begin`.
+void query_limit(Query* q, Entity begin, Entity end) {
+	q->remaining = end - begin;
+	for (; q->archetype < archetype_world.archetype_count; q->archetype++) {
+		Archetype* a = &archetype_world.archetypes[q->archetype];
+		if ((a->mask & q->mask) != q->mask) {
+			continue;
+		}
+		if (begin < a->count) {
+			q->row = begin;
+			return;
+		}
+		begin -= a->count;
+	}
+}
+
+bool query_next(Query* q) {
+	while (q->remaining > 0 && q->archetype < archetype_world.archetype_count) {
+		Archetype* a = &archetype_world.archetypes[q->archetype];
+		if ((a->mask & q->mask) == q->mask && q->row < a->count) {
+			Entity row = q->row++;
+			q->remaining--;
+			for (int i = 0; i < q->set_count; i++) {
+				q->components[i] = archetype_component(a, a->column_of[q->component[i]], row);
+			}
+			q->entity = *archetype_entity(a, row);
+			return true;
+		}
+		q->archetype++;
+		q->row = 0;
+	}
+	return false;
+}
+
+// A zero-initialised pool (`Positions positions = {0};`) is empty and ready to use.
+#define COMPONENT(ComponentName, DataType)					\
+typedef struct {								\
+	union {									\
+		ArchetypePool pool;						\
+		struct {							\
+			int id;							\
+			Entity count;						\
+		};								\
+	};									\
+} ComponentName;								\
+										\
+void add_##ComponentName(ComponentName* comp, Entity e, DataType value) { 	\
+	if (comp->id == 0) {							\
+		comp->id = archetype_register(&comp->pool, sizeof(DataType));	\
+	}									\
+	archetype_add(comp->id, e, &value);					\
+}										\
+										\
+DataType* get_##ComponentName(ComponentName* comp, Entity e) {			\
+	return archetype_get(comp->id, e);					\
+}										\
+										\
+void remove_##ComponentName(ComponentName* comp, Entity e) {			\
+	archetype_remove(comp->id, e);						\
+}										\
+										\
+void free_##ComponentName(ComponentName* comp) {				\
+	archetype_strip(comp->id);						\
+}										\
+										\
+COMPONENT_COMMANDS(ComponentName, DataType)
+
+// A tag is a zero sized column: it only shapes the archetype.
+#define TAG_COMPONENT(TagName)							\
+typedef struct {								\
+	union {									\
+		ArchetypePool pool;						\
+		struct {							\
+			int id;							\
+			Entity count;						\
+		};								\
+	};									\
+} TagName;									\
+										\
+void add_##TagName(TagName* tag, Entity e) {					\
+	if (tag->id == 0) {							\
+		tag->id = archetype_register(&tag->pool, 0);			\
+	}									\
+	archetype_add(tag->id, e, NULL);					\
+}										\
+										\
+bool has_##TagName(TagName* tag, Entity e) {					\
+	return archetype_get(tag->id, e) != NULL;				\
+}										\
+										\
+void remove_##TagName(TagName* tag, Entity e) {					\
+	archetype_remove(tag->id, e);						\
+}										\
+										\
+void free_##TagName(TagName* tag) {						\
+	archetype_strip(tag->id);						\
+}										\
+										\
+TAG_COMPONENT_COMMANDS(TagName)
+
+#endif // ECS_ARCHETYPE_H
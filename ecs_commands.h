@@ -0,0 +1,247 @@
+#ifndef ECS_COMMANDS_H
+#define ECS_COMMANDS_H
+
+// Deferred structural changes, included by ecs.h. Systems that would add or
+// remove components while iterating, or that run on several threads at once,
+// record the change instead, and command_buffer_apply performs everything
+// recorded at a sync point of the caller's choosing:
+//
+//	defer_add_Sounds(&commands, writer, sounds, e, sound);
+//	defer_remove_Positions(&commands, writer, positions, e);
+//	...
+//	command_buffer_apply(&commands, &entities);	// once no system is running
+//
+// A writer is a stream of commands with a fixed place in the apply order,
+// recorded by one thread at a time, so recording never locks. Give each
+// system its own writer, in a fixed order, rather than the index of the
+// worker running it: commands for the same entity and pool apply in writer
+// order, then in the order they were recorded, and that order must not
+// depend on scheduling. command_create hands out a placeholder handle that
+// only that writer's later commands may use; it becomes a real entity when
+// the buffer is applied. Creations are applied first and destructions last.
+// In between, component commands are grouped by pool and then by entity, so
+// each pool is mutated in one run.
+#define COMMAND_MAX_WRITERS 32
+#define COMMAND_VALUE_ALIGNMENT 16
+
+typedef void (*CommandAdd)(void* pool, Entity e, const void* value);
+typedef void (*CommandRemove)(void* pool, Entity e);
+
+enum CommandKind {
+	COMMAND_ADD,
+	COMMAND_REMOVE,
+	COMMAND_DESTROY,
+};
+
+typedef struct Command {
+	enum CommandKind kind;
+	void* pool;
+	CommandAdd add;
+	CommandRemove remove;
+	Entity entity;
+	uint32_t writer;
+	uint32_t sequence;
+	// offset of the component value in the writer's `values`
+	size_t value;
+} Command;
+
+typedef struct CommandWriter {
+	Command* commands;
+	uint32_t count;
+	uint32_t capacity;
+	unsigned char* values;
+	size_t value_size;
+	size_t value_capacity;
+	// placeholders handed out, and the entities they became while applying
+	Entity* created;
+	uint32_t created_count;
+	uint32_t created_capacity;
+} CommandWriter;
+
+typedef struct CommandBuffer {
+	CommandWriter writers[COMMAND_MAX_WRITERS];
+	// every command of an apply, in apply order
+	Command** sorted;
+	uint32_t sorted_capacity;
+} CommandBuffer;
+
+// placeholders count down from below NULL_ENTITY
+#define COMMAND_PLACEHOLDER(index) ((Entity)(-2 - (Entity)(index)))
+#define COMMAND_PLACEHOLDER_INDEX(e) (-2 - (e))
+
+Command* command_push(CommandBuffer* buffer, int writer, enum CommandKind kind, void* pool, Entity e) {
+	assert(writer > -1 && writer < COMMAND_MAX_WRITERS);
+	CommandWriter* w = &buffer->writers[writer];
+	if (w->count == w->capacity) {
+		w->capacity = w->capacity ? w->capacity * 2 : 64;
+		w->commands = realloc(w->commands, w->capacity * sizeof(Command));
+		assert(w->commands != NULL);
+	}
+	Command* command = &w->commands[w->count];
+	*command = (Command) { .kind = kind, .pool = pool, .entity = e, .writer = writer, .sequence = w->count };
+	w->count++;
+	return command;
+}
+
+// returns a placeholder for an entity created when the buffer is applied.
+Entity command_create(CommandBuffer* buffer, int writer) {
+	CommandWriter* w = &buffer->writers[writer];
+	if (w->created_count == w->created_capacity) {
+		w->created_capacity = w->created_capacity ? w->created_capacity * 2 : 16;
+		w->created = realloc(w->created, w->created_capacity * sizeof(Entity));
+		assert(w->created != NULL);
+	}
+	w->created[w->created_count] = NULL_ENTITY;
+	return COMMAND_PLACEHOLDER(w->created_count++);
+}
+
+// Components are not removed by this; record their removal as well.
+void command_destroy(CommandBuffer* buffer, int writer, Entity e) {
+	command_push(buffer, writer, COMMAND_DESTROY, NULL, e);
+}
+
+// copies `size` bytes of `value`; the COMPONENT macros generate typed defer_add_ wrappers.
+void command_add(CommandBuffer* buffer, int writer, void* pool, CommandAdd add, Entity e, const void* value, size_t size) {
+	Command* command = command_push(buffer, writer, COMMAND_ADD, pool, e);
+	command->add = add;
+	CommandWriter* w = &buffer->writers[writer];
+	size_t start = (w->value_size + COMMAND_VALUE_ALIGNMENT - 1) & ~(size_t)(COMMAND_VALUE_ALIGNMENT - 1);
+	if (start + size > w->value_capacity) {
+		w->value_capacity = w->value_capacity ? w->value_capacity * 2 : 1024;
+		while (start + size > w->value_capacity) {
+			w->value_capacity *= 2;
+		}
+		w->values = realloc(w->values, w->value_capacity);
+		assert(w->values != NULL);
+	}
+	if (size > 0) {
+		memcpy(w->values + start, value, size);
+	}
+	w->value_size = start + size;
+	command->value = start;
+}
+
+void command_remove(CommandBuffer* buffer, int writer, void* pool, CommandRemove remove, Entity e) {
+	Command* command = command_push(buffer, writer, COMMAND_REMOVE, pool, e);
+	command->remove = remove;
+}
+
+int command_compare(const void* a, const void* b) {
+	const Command* command_a = *(const Command* const*)a;
+	const Command* command_b = *(const Command* const*)b;
+	bool destroy_a = command_a->kind == COMMAND_DESTROY;
+	bool destroy_b = command_b->kind == COMMAND_DESTROY;
+	if (destroy_a != destroy_b) {
+		return destroy_a - destroy_b;
+	}
+	if (command_a->pool != command_b->pool) {
+		return (uintptr_t)command_a->pool < (uintptr_t)command_b->pool ? -1 : 1;
+	}
+	if (command_a->entity != command_b->entity) {
+		return command_a->entity < command_b->entity ? -1 : 1;
+	}
+	if (command_a->writer != command_b->writer) {
+		return command_a->writer < command_b->writer ? -1 : 1;
+	}
+	return (command_a->sequence > command_b->sequence) - (command_a->sequence < command_b->sequence);
+}
+
+// performs and forgets every recorded command. No writer may record while this runs.
+void command_buffer_apply(CommandBuffer* buffer, Entities* entities) {
+	uint32_t total = 0;
+	for (int i = 0; i < COMMAND_MAX_WRITERS; i++) {
+		CommandWriter* w = &buffer->writers[i];
+		for (uint32_t j = 0; j < w->created_count; j++) {
+			w->created[j] = create_entity(entities);
+		}
+		total += w->count;
+	}
+	if (total > buffer->sorted_capacity) {
+		buffer->sorted_capacity = total;
+		buffer->sorted = realloc(buffer->sorted, total * sizeof(Command*));
+		assert(buffer->sorted != NULL);
+	}
+	uint32_t count = 0;
+	for (int i = 0; i < COMMAND_MAX_WRITERS; i++) {
+		CommandWriter* w = &buffer->writers[i];
+		for (uint32_t j = 0; j < w->count; j++) {
+			Command* command = &w->commands[j];
+			if (command->entity < NULL_ENTITY) {
+				assert(COMMAND_PLACEHOLDER_INDEX(command->entity) < (Entity)w->created_count);
+				command->entity = w->created[COMMAND_PLACEHOLDER_INDEX(command->entity)];
+			}
+			buffer->sorted[count++] = command;
+		}
+	}
+	qsort(buffer->sorted, count, sizeof(Command*), command_compare);
+
+	for (uint32_t i = 0; i < count; i++) {
+		Command* command = buffer->sorted[i];
+		switch (command->kind) {
+		case COMMAND_ADD:
+			command->add(command->pool, command->entity, buffer->writers[command->writer].values + command->value);
+			break;
+		case COMMAND_REMOVE:
+			command->remove(command->pool, command->entity);
+			break;
+		case COMMAND_DESTROY:
+			destroy_entity(entities, command->entity);
+			break;
+		}
+	}
+
+	for (int i = 0; i < COMMAND_MAX_WRITERS; i++) {
+		CommandWriter* w = &buffer->writers[i];
+		w->count = 0;
+		w->value_size = 0;
+		w->created_count = 0;
+	}
+}
+
+void command_buffer_free(CommandBuffer* buffer) {
+	for (int i = 0; i < COMMAND_MAX_WRITERS; i++) {
+		free(buffer->writers[i].commands);
+		free(buffer->writers[i].values);
+		free(buffer->writers[i].created);
+	}
+	free(buffer->sorted);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+// Expanded by both backends' COMPONENT and TAG_COMPONENT:
+// `defer_add_Pool(buffer, writer, pool, e, value)` and `defer_remove_Pool(buffer, writer, pool, e)`.
+#define COMPONENT_COMMANDS(ComponentName, DataType)				\
+void apply_add_##ComponentName(void* pool, Entity e, const void* value) {	\
+	add_##ComponentName(pool, e, *(const DataType*)value);			\
+}										\
+										\
+void apply_remove_##ComponentName(void* pool, Entity e) {			\
+	remove_##ComponentName(pool, e);					\
+}										\
+										\
+void defer_add_##ComponentName(CommandBuffer* buffer, int writer, ComponentName* comp, Entity e, DataType value) { \
+	command_add(buffer, writer, comp, apply_add_##ComponentName, e, &value, sizeof(DataType)); \
+}										\
+										\
+void defer_remove_##ComponentName(CommandBuffer* buffer, int writer, ComponentName* comp, Entity e) { \
+	command_remove(buffer, writer, comp, apply_remove_##ComponentName, e);	\
+}
+
+#define TAG_COMPONENT_COMMANDS(TagName)						\
+void apply_add_##TagName(void* pool, Entity e, const void* value) {		\
+	add_##TagName(pool, e);							\
+}										\
+										\
+void apply_remove_##TagName(void* pool, Entity e) {				\
+	remove_##TagName(pool, e);						\
+}										\
+										\
+void defer_add_##TagName(CommandBuffer* buffer, int writer, TagName* tag, Entity e) { \
+	command_add(buffer, writer, tag, apply_add_##TagName, e, NULL, 0);	\
+}										\
+										\
+void defer_remove_##TagName(CommandBuffer* buffer, int writer, TagName* tag, Entity e) { \
+	command_remove(buffer, writer, tag, apply_remove_##TagName, e);		\
+}
+
+#endif // ECS_COMMANDS_H
@@ -0,0 +1,368 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+
+// Work stealing thread pool. Every worker, and the thread that submits work
+// (worker 0), has its own job deque: a worker pushes and pops at the bottom
+// of its own deque and, when it runs dry, steals from the top of another's.
+// Jobs get the index of the worker running them, so they can use per-worker
+// state without locking.
+//
+// On top of it, a JobGraph runs systems by declared access. Every node names
+// the pools it reads and writes as bit masks; job_graph_build orders each node
+// after every earlier node it conflicts with (a write against a read or a
+// write), once. job_graph_run then starts the nodes whose dependencies are
+// done, so independent systems run concurrently while conflicting ones keep
+// their registration order. Every node is timed by the profiler under its
+// name.
+//
+// Inside a job, job_parallel_for splits a range of rows into chunks that the
+// idle workers pull one at a time, and JobBuffers give every worker its own
+// output array for results that would otherwise race, which
+// job_buffers_merge concatenates once the loop has returned.
+#define JOB_MAX_WORKERS 32
+#define JOB_QUEUE_CAPACITY 1024
+#define JOB_GRAPH_MAX_NODES 32
+
+typedef struct JobSystem JobSystem;
+typedef void (*JobFunction)(JobSystem* jobs, int worker, void* data);
+
+typedef struct Job {
+	JobFunction function;
+	void* data;
+	// decremented once the job has run
+	SDL_AtomicInt* counter;
+} Job;
+
+typedef struct JobQueue {
+	SDL_Mutex* lock;
+	Job jobs[JOB_QUEUE_CAPACITY];
+	// jobs live in [top, bottom), indices wrap around the capacity
+	uint32_t top;
+	uint32_t bottom;
+} JobQueue;
+
+typedef struct JobWorker {
+	JobSystem* jobs;
+	int index;
+	SDL_Thread* thread;
+} JobWorker;
+
+struct JobSystem {
+	// worker 0 is the submitting thread, the rest are pool threads
+	int worker_count;
+	JobWorker workers[JOB_MAX_WORKERS];
+	JobQueue queues[JOB_MAX_WORKERS];
+	SDL_Semaphore* wake;
+	SDL_AtomicInt running;
+};
+
+bool job_queue_pop(JobQueue* queue, Job* job) {
+	SDL_LockMutex(queue->lock);
+	bool found = queue->bottom != queue->top;
+	if (found) {
+		*job = queue->jobs[--queue->bottom % JOB_QUEUE_CAPACITY];
+	}
+	SDL_UnlockMutex(queue->lock);
+	return found;
+}
+
+bool job_queue_steal(JobQueue* queue, Job* job) {
+	SDL_LockMutex(queue->lock);
+	bool found = queue->bottom != queue->top;
+	if (found) {
+		*job = queue->jobs[queue->top++ % JOB_QUEUE_CAPACITY];
+	}
+	SDL_UnlockMutex(queue->lock);
+	return found;
+}
+
+// queues a job on `worker`'s own deque; `counter` (may be NULL) is decremented when it has run.
+void job_push(JobSystem* jobs, int worker, JobFunction function, void* data, SDL_AtomicInt* counter) {
+	JobQueue* queue = &jobs->queues[worker];
+	SDL_LockMutex(queue->lock);
+	assert(queue->bottom - queue->top < JOB_QUEUE_CAPACITY);
+	queue->jobs[queue->bottom++ % JOB_QUEUE_CAPACITY] = (Job) { .function = function, .data = data, .counter = counter };
+	SDL_UnlockMutex(queue->lock);
+	SDL_SignalSemaphore(jobs->wake);
+}
+
+// runs one job from `worker`'s deque or one stolen from another; returns false if there was none.
+bool job_run_one(JobSystem* jobs, int worker) {
+	Job job;
+	bool found = job_queue_pop(&jobs->queues[worker], &job);
+	for (int i = 1; !found && i < jobs->worker_count; i++) {
+		found = job_queue_steal(&jobs->queues[(worker + i) % jobs->worker_count], &job);
+	}
+	if (!found) {
+		return false;
+	}
+	job.function(jobs, worker, job.data);
+	if (job.counter != NULL) {
+		SDL_AddAtomicInt(job.counter, -1);
+	}
+	return true;
+}
+
+// helps out with queued jobs until `counter` drops to zero.
+void job_wait(JobSystem* jobs, int worker, SDL_AtomicInt* counter) {
+	while (SDL_GetAtomicInt(counter) > 0) {
+		if (!job_run_one(jobs, worker)) {
+			SDL_CPUPauseInstruction();
+		}
+	}
+}
+
+int SDLCALL job_worker_main(void* data) {
+	JobWorker* worker = data;
+	JobSystem* jobs = worker->jobs;
+	profile_thread("job worker");
+	while (SDL_GetAtomicInt(&jobs->running)) {
+		SDL_WaitSemaphore(jobs->wake);
+		while (job_run_one(jobs, worker->index)) {
+		}
+	}
+	return 0;
+}
+
+// starts `thread_count` pool threads, clamped to what fits next to the submitting thread.
+bool job_system_init(JobSystem* jobs, int thread_count) {
+	memset(jobs, 0, sizeof(*jobs));
+	if (thread_count < 0) {
+		thread_count = 0;
+	}
+	if (thread_count > JOB_MAX_WORKERS - 1) {
+		thread_count = JOB_MAX_WORKERS - 1;
+	}
+	jobs->worker_count = thread_count + 1;
+	jobs->wake = SDL_CreateSemaphore(0);
+	if (jobs->wake == NULL) {
+		SDL_Log("Failed to create job semaphore: %s", SDL_GetError());
+		return false;
+	}
+	for (int i = 0; i < jobs->worker_count; i++) {
+		jobs->queues[i].lock = SDL_CreateMutex();
+		if (jobs->queues[i].lock == NULL) {
+			SDL_Log("Failed to create job queue lock: %s", SDL_GetError());
+			return false;
+		}
+	}
+	SDL_SetAtomicInt(&jobs->running, 1);
+	for (int i = 1; i < jobs->worker_count; i++) {
+		jobs->workers[i] = (JobWorker) { .jobs = jobs, .index = i };
+		jobs->workers[i].thread = SDL_CreateThread(job_worker_main, "job worker", &jobs->workers[i]);
+		if (jobs->workers[i].thread == NULL) {
+			SDL_Log("Failed to start job worker: %s", SDL_GetError());
+			// run with the workers started so far
+			jobs->worker_count = i;
+			break;
+		}
+	}
+	return true;
+}
+
+void job_system_free(JobSystem* jobs) {
+	SDL_SetAtomicInt(&jobs->running, 0);
+	for (int i = 1; i < jobs->worker_count; i++) {
+		SDL_SignalSemaphore(jobs->wake);
+	}
+	for (int i = 1; i < jobs->worker_count; i++) {
+		SDL_WaitThread(jobs->workers[i].thread, NULL);
+	}
+	for (int i = 0; i < jobs->worker_count; i++) {
+		SDL_DestroyMutex(jobs->queues[i].lock);
+	}
+	SDL_DestroySemaphore(jobs->wake);
+	memset(jobs, 0, sizeof(*jobs));
+}
+
+typedef void (*JobRangeFunction)(int worker, int32_t begin, int32_t end, void* data);
+
+typedef struct JobParallelFor {
+	JobRangeFunction function;
+	void* data;
+	int32_t count;
+	int32_t chunk_size;
+	SDL_AtomicInt next_chunk;
+} JobParallelFor;
+
+// runs chunks until none are left; chunks are claimed, not assigned, so a slow one does not hold up the rest.
+void job_parallel_for_chunks(JobSystem* jobs, int worker, void* data) {
+	JobParallelFor* loop = data;
+	PROFILE_SCOPE("parallel for");
+	for (;;) {
+		int32_t begin = SDL_AddAtomicInt(&loop->next_chunk, 1) * loop->chunk_size;
+		if (begin >= loop->count) {
+			return;
+		}
+		int32_t end = loop->count - begin < loop->chunk_size ? loop->count : begin + loop->chunk_size;
+		loop->function(worker, begin, end, loop->data);
+	}
+}
+
+// calls `function` over [0, count) in chunks of `chunk_size` rows on every free worker and returns when all are done.
+void job_parallel_for(JobSystem* jobs, int worker, int32_t count, int32_t chunk_size, JobRangeFunction function, void* data) {
+	if (count <= 0) {
+		return;
+	}
+	JobParallelFor loop = { .function = function, .data = data, .count = count, .chunk_size = chunk_size };
+	int32_t chunk_count = (count + chunk_size - 1) / chunk_size;
+	int helpers = chunk_count - 1 < jobs->worker_count - 1 ? chunk_count - 1 : jobs->worker_count - 1;
+	SDL_AtomicInt pending;
+	SDL_SetAtomicInt(&pending, helpers);
+	for (int i = 0; i < helpers; i++) {
+		job_push(jobs, worker, job_parallel_for_chunks, &loop, &pending);
+	}
+	job_parallel_for_chunks(jobs, worker, &loop);
+	job_wait(jobs, worker, &pending);
+}
+
+// One growable array per worker.
+typedef struct JobBuffers {
+	size_t stride;
+	void* items[JOB_MAX_WORKERS];
+	uint32_t counts[JOB_MAX_WORKERS];
+	uint32_t capacities[JOB_MAX_WORKERS];
+	// every worker's items in worker order, see job_buffers_merge
+	void* merged;
+	uint32_t merged_capacity;
+} JobBuffers;
+
+// appends an uninitialised item to `worker`'s array and returns it.
+void* job_buffers_push(JobBuffers* buffers, int worker) {
+	if (buffers->counts[worker] == buffers->capacities[worker]) {
+		buffers->capacities[worker] = buffers->capacities[worker] ? buffers->capacities[worker] * 2 : 64;
+		buffers->items[worker] = realloc(buffers->items[worker], buffers->capacities[worker] * buffers->stride);
+		assert(buffers->items[worker] != NULL);
+	}
+	return (char*)buffers->items[worker] + buffers->counts[worker]++ * buffers->stride;
+}
+
+void job_buffers_clear(JobBuffers* buffers) {
+	memset(buffers->counts, 0, sizeof(buffers->counts));
+}
+
+// returns the items of every worker in one array, valid until the next merge, and their count in `p_count`.
+void* job_buffers_merge(JobBuffers* buffers, uint32_t* p_count) {
+	uint32_t count = 0;
+	for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+		count += buffers->counts[i];
+	}
+	if (count > buffers->merged_capacity) {
+		buffers->merged_capacity = count;
+		buffers->merged = realloc(buffers->merged, count * buffers->stride);
+		assert(buffers->merged != NULL);
+	}
+	count = 0;
+	for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+		if (buffers->counts[i] > 0) {
+			memcpy((char*)buffers->merged + count * buffers->stride, buffers->items[i], buffers->counts[i] * buffers->stride);
+			count += buffers->counts[i];
+		}
+	}
+	*p_count = count;
+	return buffers->merged;
+}
+
+void job_buffers_free(JobBuffers* buffers) {
+	for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+		free(buffers->items[i]);
+	}
+	free(buffers->merged);
+	size_t stride = buffers->stride;
+	memset(buffers, 0, sizeof(*buffers));
+	buffers->stride = stride;
+}
+
+typedef struct JobGraph JobGraph;
+
+typedef struct JobNode {
+	const char* name;
+	JobFunction function;
+	void* data;
+	uint64_t reads;
+	uint64_t writes;
+	JobGraph* graph;
+	int dependents[JOB_GRAPH_MAX_NODES];
+	int dependent_count;
+	int dependency_count;
+	SDL_AtomicInt remaining;
+} JobNode;
+
+struct JobGraph {
+	JobNode nodes[JOB_GRAPH_MAX_NODES];
+	int node_count;
+	// nodes of the current run that have not finished
+	SDL_AtomicInt pending;
+};
+
+void job_graph_add(JobGraph* graph, const char* name, JobFunction function, void* data, uint64_t reads, uint64_t writes) {
+	assert(graph->node_count < JOB_GRAPH_MAX_NODES);
+	graph->nodes[graph->node_count++] = (JobNode) {
+		.name = name,
+		.function = function,
+		.data = data,
+		.reads = reads,
+		.writes = writes,
+		.graph = graph,
+	};
+}
+
+void job_graph_build(JobGraph* graph) {
+	for (int i = 0; i < graph->node_count; i++) {
+		JobNode* node = &graph->nodes[i];
+		node->dependency_count = 0;
+		node->dependent_count = 0;
+	}
+	for (int i = 0; i < graph->node_count; i++) {
+		JobNode* node = &graph->nodes[i];
+		for (int j = 0; j < i; j++) {
+			JobNode* earlier = &graph->nodes[j];
+			bool conflict = (node->writes & (earlier->reads | earlier->writes)) || (node->reads & earlier->writes);
+			if (conflict) {
+				earlier->dependents[earlier->dependent_count++] = i;
+				node->dependency_count++;
+			}
+		}
+	}
+}
+
+void job_graph_run_node(JobSystem* jobs, int worker, void* data) {
+	JobNode* node = data;
+	JobGraph* graph = node->graph;
+	{
+		PROFILE_SCOPE(node->name);
+		node->function(jobs, worker, node->data);
+	}
+	for (int i = 0; i < node->dependent_count; i++) {
+		JobNode* dependent = &graph->nodes[node->dependents[i]];
+		// SDL_AddAtomicInt returns the value before the add
+		if (SDL_AddAtomicInt(&dependent->remaining, -1) == 1) {
+			job_push(jobs, worker, job_graph_run_node, dependent, &graph->pending);
+		}
+	}
+}
+
+// runs every node of a built graph once and returns when all have finished.
+void job_graph_run(JobSystem* jobs, JobGraph* graph) {
+	SDL_SetAtomicInt(&graph->pending, graph->node_count);
+	for (int i = 0; i < graph->node_count; i++) {
+		SDL_SetAtomicInt(&graph->nodes[i].remaining, graph->nodes[i].dependency_count);
+	}
+	for (int i = 0; i < graph->node_count; i++) {
+		if (graph->nodes[i].dependency_count == 0) {
+			job_push(jobs, 0, job_graph_run_node, &graph->nodes[i], &graph->pending);
+		}
+	}
+	job_wait(jobs, 0, &graph->pending);
+}
+
+#endif // JOBS_H
@@ -0,0 +1,211 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Software mixer with a fixed pool of voices feeding one audio stream bound
+// to the output device. Sounds are 32 bit float PCM in the mixer's format and
+// are played straight from their (shared, read-only) buffers, so starting a
+// sound never allocates. The stream's get callback mixes all active voices on
+// the audio thread; the play/stop commands take the stream lock.
+//
+// A voice can also pull its samples from a source callback instead of a
+// buffer (see music_stream.h). The callback runs on the audio thread, returns
+// how many samples it wrote, and -1 once the source has ended.
+//
+// When every voice is busy a new sound steals the lowest priority voice,
+// oldest first, as long as that priority is not above its own; otherwise it
+// is dropped.
+#define MIXER_VOICE_COUNT 32
+#define MIXER_MIX_SAMPLES 4096
+#define MIXER_NO_VOICE 0
+
+// index of the voice in the low byte, generation of its sound above it
+typedef uint32_t MixerVoiceId;
+typedef int (*MixerPull)(void* userdata, float* samples, int sample_count);
+
+typedef struct MixerVoice {
+	const float* samples;
+	uint32_t sample_count;
+	uint32_t cursor;
+	MixerPull pull;
+	void* userdata;
+	uint32_t generation;
+	int priority;
+	bool loop;
+	bool active;
+} MixerVoice;
+
+typedef struct Mixer {
+	SDL_AudioSpec spec;
+	SDL_AudioStream* stream;
+	MixerVoice voices[MIXER_VOICE_COUNT];
+	uint32_t generation;
+	float mix_buffer[MIXER_MIX_SAMPLES];
+	float pull_buffer[MIXER_MIX_SAMPLES];
+} Mixer;
+
+void SDLCALL mixer_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount) {
+	(void)total_amount;
+	Mixer* mixer = userdata;
+	int sample_count = additional_amount / (int)sizeof(float);
+	while (sample_count > 0) {
+		int n = sample_count < MIXER_MIX_SAMPLES ? sample_count : MIXER_MIX_SAMPLES;
+		memset(mixer->mix_buffer, 0, n * sizeof(float));
+		for (int v = 0; v < MIXER_VOICE_COUNT; v++) {
+			MixerVoice* voice = &mixer->voices[v];
+			if (voice->active && voice->pull != NULL) {
+				// a source that falls behind is silent until it catches up
+				int pulled = voice->pull(voice->userdata, mixer->pull_buffer, n);
+				for (int s = 0; s < pulled; s++) {
+					mixer->mix_buffer[s] += mixer->pull_buffer[s];
+				}
+				voice->active = pulled >= 0;
+				continue;
+			}
+			int i = 0;
+			while (voice->active && i < n) {
+				uint32_t left = voice->sample_count - voice->cursor;
+				uint32_t count = (uint32_t)(n - i) < left ? (uint32_t)(n - i) : left;
+				const float* src = voice->samples + voice->cursor;
+				for (uint32_t s = 0; s < count; s++) {
+					mixer->mix_buffer[i + s] += src[s];
+				}
+				i += count;
+				voice->cursor += count;
+				if (voice->cursor == voice->sample_count) {
+					voice->cursor = 0;
+					voice->active = voice->loop;
+				}
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			float s = mixer->mix_buffer[i];
+			mixer->mix_buffer[i] = s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s);
+		}
+		SDL_PutAudioStreamData(stream, mixer->mix_buffer, n * sizeof(float));
+		sample_count -= n;
+	}
+}
+
+// `spec` must be SDL_AUDIO_F32; every sound played must already be in it.
+bool mixer_init(Mixer* mixer, SDL_AudioDeviceID device, const SDL_AudioSpec* spec) {
+	memset(mixer, 0, sizeof(*mixer));
+	mixer->spec = *spec;
+	mixer->stream = SDL_CreateAudioStream(&mixer->spec, NULL);
+	if (!mixer->stream) {
+		SDL_Log("Failed to create mixer stream: %s", SDL_GetError());
+		return false;
+	}
+	if (!SDL_SetAudioStreamGetCallback(mixer->stream, mixer_callback, mixer)) {
+		SDL_Log("Failed to set mixer callback: %s", SDL_GetError());
+		return false;
+	}
+	if (!SDL_BindAudioStream(device, mixer->stream)) {
+		SDL_Log("Failed to bind mixer stream: %s", SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+MixerVoice* mixer_voice(Mixer* mixer, MixerVoiceId id) {
+	if (id == MIXER_NO_VOICE) {
+		return NULL;
+	}
+	MixerVoice* voice = &mixer->voices[(id & 0xFF) % MIXER_VOICE_COUNT];
+	return voice->generation == id >> 8 ? voice : NULL;
+}
+
+// takes a free or stolen voice for `voice` and returns its id, or MIXER_NO_VOICE.
+MixerVoiceId mixer_start(Mixer* mixer, MixerVoice voice) {
+	if (mixer->stream == NULL) {
+		return MIXER_NO_VOICE;
+	}
+	SDL_LockAudioStream(mixer->stream);
+	int chosen = -1;
+	for (int v = 0; v < MIXER_VOICE_COUNT; v++) {
+		MixerVoice* candidate = &mixer->voices[v];
+		if (!candidate->active) {
+			chosen = v;
+			break;
+		}
+		if (candidate->priority > voice.priority) {
+			continue;
+		}
+		if (chosen < 0 ||
+			candidate->priority < mixer->voices[chosen].priority ||
+			(candidate->priority == mixer->voices[chosen].priority && candidate->generation < mixer->voices[chosen].generation)) {
+			chosen = v;
+		}
+	}
+	MixerVoiceId id = MIXER_NO_VOICE;
+	if (chosen >= 0) {
+		// generation 0 never matches an id, so it is skipped when wrapping
+		if ((++mixer->generation & 0xFFFFFF) == 0) {
+			mixer->generation = 1;
+		}
+		voice.generation = mixer->generation & 0xFFFFFF;
+		voice.active = true;
+		mixer->voices[chosen] = voice;
+		id = (voice.generation << 8) | (uint32_t)chosen;
+	}
+	SDL_UnlockAudioStream(mixer->stream);
+	return id;
+}
+
+// plays `length` bytes of samples from a buffer that must outlive the voice.
+MixerVoiceId mixer_play(Mixer* mixer, const void* data, uint32_t length, int priority, bool loop) {
+	uint32_t sample_count = length / sizeof(float);
+	if (data == NULL || sample_count == 0) {
+		return MIXER_NO_VOICE;
+	}
+	return mixer_start(mixer, (MixerVoice) {
+		.samples = data,
+		.sample_count = sample_count,
+		.priority = priority,
+		.loop = loop,
+	});
+}
+
+// plays samples pulled from `pull` on the audio thread until it returns -1.
+MixerVoiceId mixer_play_source(Mixer* mixer, MixerPull pull, void* userdata, int priority) {
+	return mixer_start(mixer, (MixerVoice) {
+		.pull = pull,
+		.userdata = userdata,
+		.priority = priority,
+	});
+}
+
+// the voice stops reading its samples or source before this returns, so they may be freed afterwards.
+void mixer_stop(Mixer* mixer, MixerVoiceId id) {
+	if (mixer->stream == NULL) {
+		return;
+	}
+	SDL_LockAudioStream(mixer->stream);
+	MixerVoice* voice = mixer_voice(mixer, id);
+	if (voice != NULL) {
+		voice->active = false;
+	}
+	SDL_UnlockAudioStream(mixer->stream);
+}
+
+bool mixer_playing(Mixer* mixer, MixerVoiceId id) {
+	if (mixer->stream == NULL) {
+		return false;
+	}
+	SDL_LockAudioStream(mixer->stream);
+	MixerVoice* voice = mixer_voice(mixer, id);
+	bool playing = voice != NULL && voice->active;
+	SDL_UnlockAudioStream(mixer->stream);
+	return playing;
+}
+
+void mixer_free(Mixer* mixer) {
+	SDL_DestroyAudioStream(mixer->stream);
+	mixer->stream = NULL;
+}
+
+#endif // MIXER_H
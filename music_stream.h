@@ -0,0 +1,176 @@
+#ifndef MUSIC_STREAM_H
+#define MUSIC_STREAM_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Streams a long .wav file from disk instead of decoding it whole. The file
+// is read in MUSIC_STREAM_CHUNK_BYTES chunks into an SDL_AudioStream that
+// converts them to the mixer's format; music_stream_refill tops it up from
+// the simulation thread (sys_sound) whenever less than MUSIC_STREAM_LOW_WATER
+// bytes of converted audio are left, and the mixer voice pulls from it on the
+// audio thread (SDL_AudioStream does its own locking). Only the chunk buffer and a
+// fraction of a second of converted samples are ever resident.
+#define MUSIC_STREAM_CHUNK_BYTES (16 * 1024)
+#define MUSIC_STREAM_LOW_WATER (128 * 1024)
+
+typedef struct MusicStream {
+	SDL_IOStream* file;
+	SDL_AudioSpec file_spec;
+	// byte range of the "data" chunk in the file
+	Sint64 data_start;
+	Uint32 data_length;
+	Uint32 data_read;
+	SDL_AudioStream* stream;
+	bool loop;
+	// set by the refilling thread once the last samples are in `stream`, read by the audio thread
+	SDL_AtomicInt ended;
+	uint8_t chunk[MUSIC_STREAM_CHUNK_BYTES];
+} MusicStream;
+
+// reads the RIFF chunk list up to the "data" chunk, filling in the file's format.
+bool music_stream_parse_header(MusicStream* music) {
+	char id[4];
+	Uint32 size;
+	if (SDL_ReadIO(music->file, id, 4) != 4 || memcmp(id, "RIFF", 4) != 0 ||
+		!SDL_ReadU32LE(music->file, &size) ||
+		SDL_ReadIO(music->file, id, 4) != 4 || memcmp(id, "WAVE", 4) != 0) {
+		SDL_SetError("not a RIFF/WAVE file");
+		return false;
+	}
+	bool has_format = false;
+	while (SDL_ReadIO(music->file, id, 4) == 4 && SDL_ReadU32LE(music->file, &size)) {
+		Sint64 next = SDL_TellIO(music->file) + size + (size & 1);
+		if (memcmp(id, "fmt ", 4) == 0) {
+			Uint16 format_tag, channels, block_align, bits;
+			Uint32 rate, byte_rate;
+			if (!SDL_ReadU16LE(music->file, &format_tag) || !SDL_ReadU16LE(music->file, &channels) ||
+				!SDL_ReadU32LE(music->file, &rate) || !SDL_ReadU32LE(music->file, &byte_rate) ||
+				!SDL_ReadU16LE(music->file, &block_align) || !SDL_ReadU16LE(music->file, &bits)) {
+				return false;
+			}
+			// WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of its sub format
+			if (format_tag == 0xFFFE && size >= 26) {
+				Uint16 extension_size, valid_bits;
+				Uint32 channel_mask;
+				if (!SDL_ReadU16LE(music->file, &extension_size) || !SDL_ReadU16LE(music->file, &valid_bits) ||
+					!SDL_ReadU32LE(music->file, &channel_mask) || !SDL_ReadU16LE(music->file, &format_tag)) {
+					return false;
+				}
+			}
+			if (format_tag == 1 && bits == 8) {
+				music->file_spec.format = SDL_AUDIO_U8;
+			} else if (format_tag == 1 && bits == 16) {
+				music->file_spec.format = SDL_AUDIO_S16LE;
+			} else if (format_tag == 1 && bits == 32) {
+				music->file_spec.format = SDL_AUDIO_S32LE;
+			} else if (format_tag == 3 && bits == 32) {
+				music->file_spec.format = SDL_AUDIO_F32LE;
+			} else {
+				SDL_SetError("unsupported wave format %u with %u bits", format_tag, bits);
+				return false;
+			}
+			music->file_spec.channels = channels;
+			music->file_spec.freq = rate;
+			has_format = true;
+		} else if (memcmp(id, "data", 4) == 0) {
+			if (!has_format) {
+				SDL_SetError("wave data before its format");
+				return false;
+			}
+			music->data_start = SDL_TellIO(music->file);
+			music->data_length = size;
+			return true;
+		}
+		if (SDL_SeekIO(music->file, next, SDL_IO_SEEK_SET) < 0) {
+			return false;
+		}
+	}
+	SDL_SetError("wave file has no data chunk");
+	return false;
+}
+
+void music_stream_close(MusicStream* music) {
+	if (music->file != NULL) {
+		SDL_CloseIO(music->file);
+	}
+	SDL_DestroyAudioStream(music->stream);
+	music->file = NULL;
+	music->stream = NULL;
+}
+
+// `spec` is the format the mixer pulls in.
+bool music_stream_open(MusicStream* music, const char* path, const SDL_AudioSpec* spec, bool loop) {
+	memset(music, 0, offsetof(MusicStream, chunk));
+	music->loop = loop;
+	music->file = SDL_IOFromFile(path, "rb");
+	if (music->file == NULL || !music_stream_parse_header(music)) {
+		SDL_Log("Could not open music %s: %s", path, SDL_GetError());
+		music_stream_close(music);
+		return false;
+	}
+	music->stream = SDL_CreateAudioStream(&music->file_spec, spec);
+	if (music->stream == NULL) {
+		SDL_Log("Failed to create music stream: %s", SDL_GetError());
+		music_stream_close(music);
+		return false;
+	}
+	return true;
+}
+
+// flushes the tail out of the resampler before the audio thread can see the end.
+void music_stream_end(MusicStream* music) {
+	SDL_FlushAudioStream(music->stream);
+	SDL_SetAtomicInt(&music->ended, 1);
+}
+
+// reads chunks until the low water mark is reached or the file has ended.
+void music_stream_refill(MusicStream* music) {
+	if (music->stream == NULL) {
+		return;
+	}
+	while (!SDL_GetAtomicInt(&music->ended) && SDL_GetAudioStreamAvailable(music->stream) < MUSIC_STREAM_LOW_WATER) {
+		if (music->data_read == music->data_length) {
+			if (!music->loop) {
+				music_stream_end(music);
+				break;
+			}
+			if (SDL_SeekIO(music->file, music->data_start, SDL_IO_SEEK_SET) < 0) {
+				SDL_Log("Failed to rewind music: %s", SDL_GetError());
+				music_stream_end(music);
+				break;
+			}
+			music->data_read = 0;
+		}
+		Uint32 left = music->data_length - music->data_read;
+		size_t want = left < MUSIC_STREAM_CHUNK_BYTES ? left : MUSIC_STREAM_CHUNK_BYTES;
+		size_t read = SDL_ReadIO(music->file, music->chunk, want);
+		if (read == 0) {
+			// a truncated file ends where its data does
+			music->data_length = music->data_read;
+			if (!music->loop || music->data_length == 0) {
+				music_stream_end(music);
+			}
+			continue;
+		}
+		music->data_read += read;
+		SDL_PutAudioStreamData(music->stream, music->chunk, (int)read);
+	}
+}
+
+// MixerPull for a music stream; runs on the audio thread.
+int music_stream_pull(void* userdata, float* samples, int sample_count) {
+	MusicStream* music = userdata;
+	// read before pulling, so an empty pull after it really is past the flushed tail
+	bool ended = SDL_GetAtomicInt(&music->ended);
+	int got = SDL_GetAudioStreamData(music->stream, samples, sample_count * (int)sizeof(float));
+	if (got <= 0) {
+		return ended ? -1 : 0;
+	}
+	return got / (int)sizeof(float);
+}
+
+#endif // MUSIC_STREAM_H
@@ -0,0 +1,269 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frame profiler. Timed scopes are written by the thread running them into
+// that thread's own ring of the most recent PROFILE_RING_SIZE events, so
+// recording is two clock reads and a store, with no locks:
+//
+//	void sys_something(...) {
+//		PROFILE_SCOPE("something");	// ends with the enclosing block
+//		...
+//	}
+//
+//	ProfileScope scope = profile_begin("present");	// spans inside a long function
+//	...
+//	profile_end(&scope);
+//
+// Once per frame the main thread calls profile_frame, which records the frame
+// time and folds every event written since into per-name statistics for the
+// overlay. profile_write_trace dumps what the rings still hold as Chrome
+// trace JSON (chrome://tracing, Perfetto). Scope names must be string
+// literals or otherwise outlive the profiler, and need no JSON escaping.
+// Building with -DWORLDS_BELOW_PROFILER=OFF leaves PROFILER undefined and
+// turns the scopes into no-ops; the overlay and trace are then empty.
+#define PROFILE_MAX_THREADS 40
+// a power of two
+#define PROFILE_RING_SIZE 8192
+#define PROFILE_MAX_STATS 64
+#define PROFILE_FRAME_HISTORY 240
+#define PROFILE_THREAD_NAME_LENGTH 32
+
+typedef struct ProfileEvent {
+	const char* name;
+	Uint64 start_ns;
+	Uint64 end_ns;
+} ProfileEvent;
+
+typedef struct ProfileRing {
+	char name[PROFILE_THREAD_NAME_LENGTH];
+	ProfileEvent* events;
+	// events written so far, wrapping; the next goes to slot head % PROFILE_RING_SIZE
+	SDL_AtomicInt head;
+	// events already folded into the statistics, only used by profile_frame
+	uint32_t collected;
+} ProfileRing;
+
+typedef struct ProfileStat {
+	const char* name;
+	// moving average and the longest call of the last second
+	float average_ms;
+	float max_ms;
+	float window_max_ms;
+} ProfileStat;
+
+typedef struct Profiler {
+	ProfileRing rings[PROFILE_MAX_THREADS];
+	SDL_AtomicInt ring_count;
+	ProfileStat stats[PROFILE_MAX_STATS];
+	int stat_count;
+	float frame_ms[PROFILE_FRAME_HISTORY];
+	uint32_t frame_count;
+	Uint64 last_frame_ns;
+	Uint64 window_start_ns;
+} Profiler;
+
+typedef struct ProfileScope {
+	const char* name;
+	Uint64 start_ns;
+} ProfileScope;
+
+Profiler profiler;
+#if defined(PROFILER)
+// index of the calling thread's ring, or -1 before its first event
+static _Thread_local int profile_ring = -1;
+#endif
+
+// gives the calling thread a ring named `name`; threads that record without calling this get a numbered one.
+void profile_thread(const char* name) {
+#if defined(PROFILER)
+	if (profile_ring < 0) {
+		int index = SDL_AddAtomicInt(&profiler.ring_count, 1);
+		if (index >= PROFILE_MAX_THREADS) {
+			SDL_AddAtomicInt(&profiler.ring_count, -1);
+			return;
+		}
+		ProfileRing* ring = &profiler.rings[index];
+		ring->events = calloc(PROFILE_RING_SIZE, sizeof(ProfileEvent));
+		assert(ring->events != NULL);
+		profile_ring = index;
+	}
+	SDL_snprintf(profiler.rings[profile_ring].name, PROFILE_THREAD_NAME_LENGTH, "%s", name);
+#endif
+}
+
+ProfileScope profile_begin(const char* name) {
+#if defined(PROFILER)
+	return (ProfileScope) { .name = name, .start_ns = SDL_GetTicksNS() };
+#else
+	return (ProfileScope) { .name = name };
+#endif
+}
+
+void profile_end(ProfileScope* scope) {
+#if defined(PROFILER)
+	Uint64 end_ns = SDL_GetTicksNS();
+	if (profile_ring < 0) {
+		char name[PROFILE_THREAD_NAME_LENGTH];
+		SDL_snprintf(name, sizeof(name), "thread %d", SDL_GetAtomicInt(&profiler.ring_count));
+		profile_thread(name);
+		if (profile_ring < 0) {
+			return;
+		}
+	}
+	ProfileRing* ring = &profiler.rings[profile_ring];
+	uint32_t head = (uint32_t)SDL_GetAtomicInt(&ring->head);
+	ring->events[head & (PROFILE_RING_SIZE - 1)] = (ProfileEvent) { .name = scope->name, .start_ns = scope->start_ns, .end_ns = end_ns };
+	// publishes the event to readers
+	SDL_SetAtomicInt(&ring->head, (int)(head + 1));
+#endif
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if defined(PROFILER)
+#define PROFILE_SCOPE(name) \
+	ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__) __attribute__((cleanup(profile_end))) = profile_begin(name)
+#else
+#define PROFILE_SCOPE(name) do { } while (0)
+#endif
+
+ProfileStat* profile_stat(const char* name) {
+	for (int i = 0; i < profiler.stat_count; i++) {
+		if (profiler.stats[i].name == name || strcmp(profiler.stats[i].name, name) == 0) {
+			return &profiler.stats[i];
+		}
+	}
+	if (profiler.stat_count == PROFILE_MAX_STATS) {
+		return NULL;
+	}
+	ProfileStat* stat = &profiler.stats[profiler.stat_count++];
+	*stat = (ProfileStat) { .name = name };
+	return stat;
+}
+
+// folds the events written since the last call into the statistics.
+void profile_collect(void) {
+	int ring_count = SDL_GetAtomicInt(&profiler.ring_count);
+	for (int i = 0; i < ring_count && i < PROFILE_MAX_THREADS; i++) {
+		ProfileRing* ring = &profiler.rings[i];
+		uint32_t head = (uint32_t)SDL_GetAtomicInt(&ring->head);
+		// events more than half a ring behind may be overwritten while being read
+		if (head - ring->collected > PROFILE_RING_SIZE / 2) {
+			ring->collected = head - PROFILE_RING_SIZE / 2;
+		}
+		for (; ring->collected != head; ring->collected++) {
+			ProfileEvent event = ring->events[ring->collected & (PROFILE_RING_SIZE - 1)];
+			ProfileStat* stat = profile_stat(event.name);
+			if (stat == NULL) {
+				continue;
+			}
+			float ms = (event.end_ns - event.start_ns) / 1000000.0f;
+			stat->average_ms = stat->average_ms == 0 ? ms : stat->average_ms * 0.95f + ms * 0.05f;
+			if (ms > stat->window_max_ms) {
+				stat->window_max_ms = ms;
+			}
+		}
+	}
+}
+
+// marks the start of a frame on the main thread.
+void profile_frame(void) {
+	Uint64 now = SDL_GetTicksNS();
+	if (profiler.last_frame_ns != 0) {
+		profiler.frame_ms[profiler.frame_count % PROFILE_FRAME_HISTORY] = (now - profiler.last_frame_ns) / 1000000.0f;
+		profiler.frame_count++;
+	}
+	profiler.last_frame_ns = now;
+	profile_collect();
+	if (now - profiler.window_start_ns > 1000000000) {
+		for (int i = 0; i < profiler.stat_count; i++) {
+			profiler.stats[i].max_ms = profiler.stats[i].window_max_ms;
+			profiler.stats[i].window_max_ms = 0;
+		}
+		profiler.window_start_ns = now;
+	}
+}
+
+int profile_compare_ms(const void* a, const void* b) {
+	float ms_a = *(const float*)a;
+	float ms_b = *(const float*)b;
+	return (ms_a > ms_b) - (ms_a < ms_b);
+}
+
+// frame time statistics over the recorded history; false until a frame was recorded.
+bool profile_frame_times(float* p_min_ms, float* p_average_ms, float* p_p99_ms) {
+	int count = profiler.frame_count < PROFILE_FRAME_HISTORY ? (int)profiler.frame_count : PROFILE_FRAME_HISTORY;
+	if (count == 0) {
+		return false;
+	}
+	float sorted[PROFILE_FRAME_HISTORY];
+	float sum = 0;
+	for (int i = 0; i < count; i++) {
+		sorted[i] = profiler.frame_ms[i];
+		sum += sorted[i];
+	}
+	qsort(sorted, count, sizeof(float), profile_compare_ms);
+	*p_min_ms = sorted[0];
+	*p_average_ms = sum / count;
+	*p_p99_ms = sorted[(count * 99) / 100];
+	return true;
+}
+
+// returns the time of frame `age` frames ago (0 is the last one), or 0 if it is not recorded.
+float profile_frame_ms(int age) {
+	if (age >= PROFILE_FRAME_HISTORY || (uint32_t)age >= profiler.frame_count) {
+		return 0;
+	}
+	return profiler.frame_ms[(profiler.frame_count - 1 - age) % PROFILE_FRAME_HISTORY];
+}
+
+// writes the events still in every ring as a Chrome trace.
+bool profile_write_trace(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		SDL_Log("Could not write trace %s", path);
+		return false;
+	}
+	Uint64 origin = UINT64_MAX;
+	int ring_count = SDL_GetAtomicInt(&profiler.ring_count);
+	uint32_t heads[PROFILE_MAX_THREADS];
+	for (int i = 0; i < ring_count && i < PROFILE_MAX_THREADS; i++) {
+		ProfileRing* ring = &profiler.rings[i];
+		heads[i] = (uint32_t)SDL_GetAtomicInt(&ring->head);
+		uint32_t first = heads[i] > PROFILE_RING_SIZE / 2 ? heads[i] - PROFILE_RING_SIZE / 2 : 0;
+		if (heads[i] != first && ring->events[first & (PROFILE_RING_SIZE - 1)].start_ns < origin) {
+			origin = ring->events[first & (PROFILE_RING_SIZE - 1)].start_ns;
+		}
+	}
+	fprintf(file, "{\"traceEvents\": [\n");
+	bool first_event = true;
+	for (int i = 0; i < ring_count && i < PROFILE_MAX_THREADS; i++) {
+		ProfileRing* ring = &profiler.rings[i];
+		fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			first_event ? "" : ",\n", i, ring->name);
+		first_event = false;
+		// as in profile_collect, only the newer half of the ring is safe to read
+		uint32_t first = heads[i] > PROFILE_RING_SIZE / 2 ? heads[i] - PROFILE_RING_SIZE / 2 : 0;
+		for (uint32_t e = first; e != heads[i]; e++) {
+			ProfileEvent* event = &ring->events[e & (PROFILE_RING_SIZE - 1)];
+			fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+				event->name, i, (event->start_ns - origin) / 1000.0, (event->end_ns - event->start_ns) / 1000.0);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	bool written = fclose(file) == 0;
+	if (written) {
+		SDL_Log("Wrote trace %s", path);
+	}
+	return written;
+}
+
+#endif // PROFILER_H
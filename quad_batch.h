@@ -0,0 +1,86 @@
+#ifndef QUAD_BATCH_H
+#define QUAD_BATCH_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Collects axis aligned quads for one frame and submits them with a single
+// SDL_RenderGeometry call per texture, so the number of draw calls does not
+// grow with the number of entities. Vertex and index buffers are kept between
+// frames; the index pattern only changes when the capacity grows.
+typedef struct QuadBatch {
+	SDL_Vertex* vertices;
+	int* indices;
+	int quad_count;
+	int quad_capacity;
+} QuadBatch;
+
+void quad_batch_clear(QuadBatch* batch) {
+	batch->quad_count = 0;
+}
+
+void quad_batch_reserve(QuadBatch* batch, int quad_count) {
+	if (quad_count <= batch->quad_capacity) {
+		return;
+	}
+	int capacity = batch->quad_capacity ? batch->quad_capacity : 64;
+	while (capacity < quad_count) {
+		capacity *= 2;
+	}
+	batch->vertices = realloc(batch->vertices, capacity * 4 * sizeof(SDL_Vertex));
+	batch->indices = realloc(batch->indices, capacity * 6 * sizeof(int));
+	assert(batch->vertices != NULL && batch->indices != NULL);
+	for (int quad = batch->quad_capacity; quad < capacity; quad++) {
+		int* index = &batch->indices[quad * 6];
+		int vertex = quad * 4;
+		index[0] = vertex;
+		index[1] = vertex + 1;
+		index[2] = vertex + 2;
+		index[3] = vertex + 2;
+		index[4] = vertex + 3;
+		index[5] = vertex;
+	}
+	batch->quad_capacity = capacity;
+}
+
+// returns the four vertices of a new quad (top left, top right, bottom right, bottom left).
+SDL_Vertex* quad_batch_alloc(QuadBatch* batch) {
+	quad_batch_reserve(batch, batch->quad_count + 1);
+	return &batch->vertices[batch->quad_count++ * 4];
+}
+
+// `uv` is the normalised texture region, or NULL for untextured quads.
+void quad_batch_push(QuadBatch* batch, const SDL_FRect* dst, SDL_FColor color, const SDL_FRect* uv) {
+	SDL_Vertex* v = quad_batch_alloc(batch);
+	float u0 = uv ? uv->x : 0;
+	float v0 = uv ? uv->y : 0;
+	float u1 = uv ? uv->x + uv->w : 0;
+	float v1 = uv ? uv->y + uv->h : 0;
+	v[0] = (SDL_Vertex) { .position = { dst->x, dst->y }, .color = color, .tex_coord = { u0, v0 } };
+	v[1] = (SDL_Vertex) { .position = { dst->x + dst->w, dst->y }, .color = color, .tex_coord = { u1, v0 } };
+	v[2] = (SDL_Vertex) { .position = { dst->x + dst->w, dst->y + dst->h }, .color = color, .tex_coord = { u1, v1 } };
+	v[3] = (SDL_Vertex) { .position = { dst->x, dst->y + dst->h }, .color = color, .tex_coord = { u0, v1 } };
+}
+
+// draws every queued quad with `texture` (may be NULL) and empties the batch.
+bool quad_batch_flush(QuadBatch* batch, SDL_Renderer* p_sdl_renderer, SDL_Texture* texture) {
+	bool result = true;
+	if (batch->quad_count > 0) {
+		result = SDL_RenderGeometry(p_sdl_renderer, texture, batch->vertices, batch->quad_count * 4, batch->indices, batch->quad_count * 6);
+		if (!result) {
+			SDL_Log("Failed to render quad batch: %s", SDL_GetError());
+		}
+	}
+	quad_batch_clear(batch);
+	return result;
+}
+
+void quad_batch_free(QuadBatch* batch) {
+	free(batch->vertices);
+	free(batch->indices);
+	memset(batch, 0, sizeof(*batch));
+}
+
+#endif // QUAD_BATCH_H
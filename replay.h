@@ -0,0 +1,129 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Recording and replay of a session. Given the seed the spawns were rolled
+// with, the bounds they were rolled in and the input held during every fixed
+// step, the simulation runs the same steps again, so two builds can be timed
+// on identical sessions.
+//
+// The file is a ReplayHeader followed by ReplayRuns, one per change of input,
+// each holding an input for `ticks` consecutive steps. Both are written as
+// they are laid out in memory, so files only move between hosts of the same
+// endianness.
+#define REPLAY_MAGIC 0x50524257 // "WBRP"
+#define REPLAY_VERSION 1
+
+typedef struct ReplayHeader {
+	uint32_t magic;
+	uint32_t version;
+	// nanoseconds per simulation step
+	uint64_t step_ns;
+	// steps in the file, filled in when the recording is closed
+	uint32_t tick_count;
+	uint32_t seed;
+	// spawn bounds
+	int32_t x;
+	int32_t y;
+	int32_t w;
+	int32_t h;
+} ReplayHeader;
+
+typedef struct ReplayRun {
+	uint32_t ticks;
+	uint32_t input;
+} ReplayRun;
+
+typedef struct Replay {
+	FILE* file;
+	ReplayHeader header;
+	bool recording;
+	// the run being extended while recording, or the rest of the run being played
+	ReplayRun run;
+} Replay;
+
+// starts recording to `path`; `header` needs everything but the magic, version and tick count.
+bool replay_record(Replay* replay, const char* path, ReplayHeader header) {
+	replay->file = fopen(path, "wb");
+	if (replay->file == NULL) {
+		SDL_Log("Could not record to %s", path);
+		return false;
+	}
+	replay->header = header;
+	replay->header.magic = REPLAY_MAGIC;
+	replay->header.version = REPLAY_VERSION;
+	replay->header.tick_count = 0;
+	replay->recording = true;
+	replay->run = (ReplayRun) {0};
+	return fwrite(&replay->header, sizeof(ReplayHeader), 1, replay->file) == 1;
+}
+
+// records the input held during one step.
+void replay_record_tick(Replay* replay, int input) {
+	if (replay->run.ticks > 0 && replay->run.input != (uint32_t)input) {
+		fwrite(&replay->run, sizeof(ReplayRun), 1, replay->file);
+		replay->run.ticks = 0;
+	}
+	replay->run.input = input;
+	replay->run.ticks++;
+	replay->header.tick_count++;
+}
+
+bool replay_open(Replay* replay, const char* path) {
+	replay->file = fopen(path, "rb");
+	if (replay->file == NULL) {
+		SDL_Log("Could not open replay %s", path);
+		return false;
+	}
+	replay->recording = false;
+	replay->run = (ReplayRun) {0};
+	if (fread(&replay->header, sizeof(ReplayHeader), 1, replay->file) != 1
+		|| replay->header.magic != REPLAY_MAGIC
+		|| replay->header.version != REPLAY_VERSION) {
+		SDL_Log("Not a version %d replay: %s", REPLAY_VERSION, path);
+		fclose(replay->file);
+		replay->file = NULL;
+		return false;
+	}
+	return true;
+}
+
+// reads the input of the next step into `p_input`; false once the replay has run out.
+bool replay_next_tick(Replay* replay, int* p_input) {
+	while (replay->run.ticks == 0) {
+		if (fread(&replay->run, sizeof(ReplayRun), 1, replay->file) != 1) {
+			return false;
+		}
+	}
+	replay->run.ticks--;
+	*p_input = replay->run.input;
+	return true;
+}
+
+// finishes a recording, or stops playing one.
+bool replay_close(Replay* replay) {
+	if (replay->file == NULL) {
+		return true;
+	}
+	bool written = true;
+	if (replay->recording) {
+		if (replay->run.ticks > 0) {
+			written = fwrite(&replay->run, sizeof(ReplayRun), 1, replay->file) == 1;
+		}
+		written = written
+			&& fseek(replay->file, 0, SEEK_SET) == 0
+			&& fwrite(&replay->header, sizeof(ReplayHeader), 1, replay->file) == 1;
+	}
+	written = fclose(replay->file) == 0 && written;
+	if (!written) {
+		SDL_Log("Could not finish the recording");
+	}
+	replay->file = NULL;
+	return written;
+}
+
+#endif // REPLAY_H
@@ -0,0 +1,360 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_MMAP
+#endif
+
+#include "ecs.h"
+
+// Binary world snapshots. A snapshot holds the entity allocator and a list of
+// named pools, each pool as the arrays it has in memory: dense entities,
+// dense data, tag bits and the allocated sparse pages, every array in its own
+// SNAPSHOT_ALIGNMENT aligned section of one file.
+//
+// Loading maps the file privately and points the pools at their sections, so
+// nothing is copied per entity; a pool allocates only its table of page
+// pointers. Each pool is read through once to check that its slots, members
+// and bits agree, since a damaged file would otherwise send later writes
+// outside the pool's arrays. The pools come back `borrowed` (see ecs.h): writes in place
+// stay in the private mapping, and the first change that has to grow a pool
+// copies that pool to the heap. The mapping must stay open until the pools
+// are freed. Without mmap the file is read into one buffer instead.
+//
+// Pools are matched by name and stride, and files of another SNAPSHOT_VERSION
+// are refused. Sections are written as they are laid out in memory, so files
+// only move between hosts of the same endianness, and components holding
+// pointers cannot be saved. Only the sparse set backend can save and load.
+#define SNAPSHOT_MAGIC 0x4E534257 // "WBSN"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ALIGNMENT 64
+#define SNAPSHOT_MAX_POOLS 16
+#define SNAPSHOT_NAME_LENGTH 24
+
+// a size of 0 is an empty array, whatever the offset
+typedef struct SnapshotSection {
+	uint64_t offset;
+	uint64_t size;
+} SnapshotSection;
+
+typedef struct SnapshotPool {
+	char name[SNAPSHOT_NAME_LENGTH];
+	// bytes per component, 0 for tags
+	uint64_t stride;
+	int32_t count;
+	int32_t page_count;
+	int32_t word_count;
+	SnapshotSection entities;
+	SnapshotSection data;
+	SnapshotSection bits;
+	// one file offset per sparse page, 0 for pages never allocated
+	SnapshotSection page_offsets;
+} SnapshotPool;
+
+typedef struct SnapshotHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pool_count;
+	int32_t entity_count;
+	int32_t next_index;
+	int32_t free_count;
+	SnapshotSection generations;
+	SnapshotSection free_list;
+	SnapshotPool pools[SNAPSHOT_MAX_POOLS];
+} SnapshotHeader;
+
+// A loaded file, mapped or read.
+typedef struct SnapshotMapping {
+	unsigned char* base;
+	size_t size;
+	bool mapped;
+} SnapshotMapping;
+
+bool snapshot_map(SnapshotMapping* mapping, const char* path) {
+	memset(mapping, 0, sizeof(*mapping));
+#if defined(SNAPSHOT_MMAP)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		SDL_Log("Could not open snapshot %s", path);
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || status.st_size == 0) {
+		SDL_Log("Could not read snapshot %s", path);
+		close(fd);
+		return false;
+	}
+	// private and writable, so the pools can be changed in place without touching the file
+	void* base = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		SDL_Log("Could not map snapshot %s", path);
+		return false;
+	}
+	mapping->base = base;
+	mapping->size = status.st_size;
+	mapping->mapped = true;
+#else
+	mapping->base = SDL_LoadFile(path, &mapping->size);
+	if (mapping->base == NULL) {
+		SDL_Log("Could not read snapshot %s: %s", path, SDL_GetError());
+		return false;
+	}
+#endif
+	return true;
+}
+
+void snapshot_unmap(SnapshotMapping* mapping) {
+#if defined(SNAPSHOT_MMAP)
+	if (mapping->mapped) {
+		munmap(mapping->base, mapping->size);
+	}
+#else
+	SDL_free(mapping->base);
+#endif
+	memset(mapping, 0, sizeof(*mapping));
+}
+
+#if !defined(ECS_BACKEND_ARCHETYPE)
+
+// A pool to save or load; tags have a stride of 0.
+typedef struct SnapshotEntry {
+	const char* name;
+	size_t stride;
+	EntitySet* set;
+} SnapshotEntry;
+
+// Lays the sections out one after another and, once `file` is set, writes
+// them there. Saving runs it twice over the same sections: once to fill in
+// the header, then to write them after it.
+typedef struct SnapshotWriter {
+	FILE* file;
+	uint64_t end;
+	bool failed;
+} SnapshotWriter;
+
+SnapshotSection snapshot_place(SnapshotWriter* writer, const void* data, uint64_t size) {
+	if (size == 0) {
+		return (SnapshotSection) {0};
+	}
+	uint64_t offset = (writer->end + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+	if (writer->file != NULL) {
+		static const unsigned char padding[SNAPSHOT_ALIGNMENT] = {0};
+		writer->failed |= fwrite(padding, 1, offset - writer->end, writer->file) != offset - writer->end;
+		writer->failed |= fwrite(data, 1, size, writer->file) != size;
+	}
+	writer->end = offset + size;
+	return (SnapshotSection) { .offset = offset, .size = size };
+}
+
+void snapshot_place_pool(SnapshotWriter* writer, SnapshotPool* pool, const SnapshotEntry* entry) {
+	EntitySet* set = entry->set;
+	pool->stride = entry->stride;
+	pool->count = set->count;
+	pool->page_count = set->page_count;
+	pool->word_count = set->word_count;
+	pool->entities = snapshot_place(writer, set->entities, set->count * sizeof(Entity));
+	pool->data = snapshot_place(writer, set->data, set->count * pool->stride);
+	pool->bits = snapshot_place(writer, set->bits, set->word_count * sizeof(uint64_t));
+	uint64_t* page_offsets = calloc(set->page_count + 1, sizeof(uint64_t));
+	assert(page_offsets != NULL);
+	for (Entity page = 0; page < set->page_count; page++) {
+		if (set->entity_index[page] != NULL) {
+			page_offsets[page] = snapshot_place(writer, set->entity_index[page], ENTITY_PAGE_SIZE * sizeof(Entity)).offset;
+		}
+	}
+	pool->page_offsets = snapshot_place(writer, page_offsets, set->page_count * sizeof(uint64_t));
+	free(page_offsets);
+}
+
+void snapshot_place_all(SnapshotWriter* writer, SnapshotHeader* header, const Entities* entities, const SnapshotEntry pools[]) {
+	writer->end = sizeof(SnapshotHeader);
+	header->generations = snapshot_place(writer, entities->generations, entities->next_index * sizeof(uint16_t));
+	header->free_list = snapshot_place(writer, entities->free_list, entities->free_count * sizeof(Entity));
+	for (uint32_t i = 0; i < header->pool_count; i++) {
+		snapshot_place_pool(writer, &header->pools[i], &pools[i]);
+	}
+}
+
+// writes `entities` and `pools` to `path`.
+bool snapshot_save(const char* path, const Entities* entities, int pool_count, const SnapshotEntry pools[]) {
+	assert(pool_count <= SNAPSHOT_MAX_POOLS);
+	SnapshotHeader header = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.pool_count = pool_count,
+		.entity_count = entities->count,
+		.next_index = entities->next_index,
+		.free_count = entities->free_count,
+	};
+	for (int i = 0; i < pool_count; i++) {
+		SDL_strlcpy(header.pools[i].name, pools[i].name, SNAPSHOT_NAME_LENGTH);
+	}
+	SnapshotWriter writer = {0};
+	snapshot_place_all(&writer, &header, entities, pools);
+
+	writer.file = fopen(path, "wb");
+	if (writer.file == NULL) {
+		SDL_Log("Could not write snapshot %s", path);
+		return false;
+	}
+	writer.failed = fwrite(&header, sizeof(SnapshotHeader), 1, writer.file) != 1;
+	snapshot_place_all(&writer, &header, entities, pools);
+	writer.failed |= fclose(writer.file) != 0;
+	if (writer.failed) {
+		SDL_Log("Could not write snapshot %s", path);
+	}
+	return !writer.failed;
+}
+
+// returns the section's memory, or NULL when it is empty; false in `p_valid` unless it lies in the file and has `size` bytes.
+void* snapshot_section(const SnapshotMapping* mapping, SnapshotSection section, uint64_t size, bool* p_valid) {
+	if (section.size != size
+		|| section.offset % SNAPSHOT_ALIGNMENT != 0
+		|| section.offset > mapping->size
+		|| section.size > mapping->size - section.offset) {
+		*p_valid = false;
+		return NULL;
+	}
+	return size > 0 ? mapping->base + section.offset : NULL;
+}
+
+bool snapshot_adopt_pool(const SnapshotMapping* mapping, const SnapshotPool* pool, EntitySet* set) {
+	bool valid = pool->count >= 0 && pool->page_count >= 0 && pool->word_count >= 0;
+	if (!valid) {
+		return false;
+	}
+	set->entities = snapshot_section(mapping, pool->entities, pool->count * sizeof(Entity), &valid);
+	set->data = snapshot_section(mapping, pool->data, pool->count * pool->stride, &valid);
+	set->bits = snapshot_section(mapping, pool->bits, pool->word_count * sizeof(uint64_t), &valid);
+	const uint64_t* page_offsets = snapshot_section(mapping, pool->page_offsets, pool->page_count * sizeof(uint64_t), &valid);
+	set->count = pool->count;
+	set->capacity = pool->count;
+	set->stride = pool->stride;
+	set->word_count = pool->word_count;
+	set->borrowed = true;
+	if (pool->page_count > 0) {
+		set->entity_index = calloc(pool->page_count, sizeof(Entity*));
+		assert(set->entity_index != NULL);
+		set->page_count = pool->page_count;
+		for (Entity page = 0; valid && page < pool->page_count; page++) {
+			if (page_offsets[page] != 0) {
+				SnapshotSection section = { .offset = page_offsets[page], .size = ENTITY_PAGE_SIZE * sizeof(Entity) };
+				set->entity_index[page] = snapshot_section(mapping, section, section.size, &valid);
+			}
+		}
+	}
+	return valid;
+}
+
+// checks that an adopted pool indexes itself consistently, so nothing that
+// later follows its slots or bits can step outside its arrays.
+bool snapshot_check_pool(const EntitySet* set, Entity next_index) {
+	for (Entity row = 0; row < set->count; row++) {
+		Entity e = set->entities[row];
+		if (e < 0 || ENTITY_INDEX(e) >= next_index || entity_set_find(set, e) != row) {
+			return false;
+		}
+	}
+	for (Entity page = 0; page < set->page_count; page++) {
+		for (Entity slot = 0; set->entity_index[page] != NULL && slot < ENTITY_PAGE_SIZE; slot++) {
+			Entity idx = set->entity_index[page][slot];
+			if (idx != -1 && (idx < 0 || idx >= set->count || ENTITY_INDEX(set->entities[idx]) != ((page << ENTITY_PAGE_BITS) | slot))) {
+				return false;
+			}
+		}
+	}
+	// every set bit has to belong to a member, see tag_set_add
+	Entity bit_count = 0;
+	for (Entity word = 0; word < set->word_count; word++) {
+		bit_count += __builtin_popcountll(set->bits[word]);
+	}
+	return set->bits == NULL || bit_count == set->count;
+}
+
+// Fills the empty `entities` and `pools` from the snapshot at `path`. On
+// success the pools borrow from `mapping`, which the caller unmaps once they
+// are freed; on failure everything is left empty.
+bool snapshot_load(SnapshotMapping* mapping, const char* path, Entities* entities, int pool_count, const SnapshotEntry pools[]) {
+	if (!snapshot_map(mapping, path)) {
+		return false;
+	}
+	const SnapshotHeader* header = (const SnapshotHeader*)mapping->base;
+	bool valid = mapping->size >= sizeof(SnapshotHeader)
+		&& header->magic == SNAPSHOT_MAGIC
+		&& header->version == SNAPSHOT_VERSION;
+	if (!valid) {
+		SDL_Log("Not a version %d snapshot: %s", SNAPSHOT_VERSION, path);
+		snapshot_unmap(mapping);
+		return false;
+	}
+	valid = header->pool_count == (uint32_t)pool_count
+		&& header->next_index >= 0 && header->next_index <= MAX_ENTITY_COUNT
+		&& header->free_count >= 0 && header->free_count <= header->next_index
+		&& header->entity_count == header->next_index - header->free_count;
+	for (int i = 0; valid && i < pool_count; i++) {
+		valid = strncmp(header->pools[i].name, pools[i].name, SNAPSHOT_NAME_LENGTH) == 0
+			&& header->pools[i].stride == pools[i].stride;
+	}
+	if (!valid) {
+		SDL_Log("Snapshot %s was saved with other pools", path);
+		snapshot_unmap(mapping);
+		return false;
+	}
+
+	// the allocator is small and grows by realloc, so it is copied rather than borrowed
+	const uint16_t* generations = snapshot_section(mapping, header->generations, header->next_index * sizeof(uint16_t), &valid);
+	const Entity* free_list = snapshot_section(mapping, header->free_list, header->free_count * sizeof(Entity), &valid);
+	// a slot outside the allocator, or freed twice, would be handed out wrongly
+	bool* freed = calloc(header->next_index + 1, sizeof(bool));
+	assert(freed != NULL);
+	for (Entity i = 0; valid && i < header->free_count; i++) {
+		valid = free_list[i] >= 0 && free_list[i] < header->next_index && !freed[free_list[i]];
+		if (valid) {
+			freed[free_list[i]] = true;
+		}
+	}
+	free(freed);
+	if (valid && header->next_index > 0) {
+		entities->capacity = header->next_index;
+		entities->generations = malloc(entities->capacity * sizeof(uint16_t));
+		entities->free_list = malloc(entities->capacity * sizeof(Entity));
+		assert(entities->generations != NULL && entities->free_list != NULL);
+		memcpy(entities->generations, generations, header->next_index * sizeof(uint16_t));
+		if (header->free_count > 0) {
+			memcpy(entities->free_list, free_list, header->free_count * sizeof(Entity));
+		}
+		entities->next_index = header->next_index;
+		entities->free_count = header->free_count;
+		entities->count = header->entity_count;
+	}
+	for (int i = 0; valid && i < pool_count; i++) {
+		assert(pools[i].set->count == 0 && pools[i].set->entity_index == NULL);
+		valid = snapshot_adopt_pool(mapping, &header->pools[i], pools[i].set)
+			&& snapshot_check_pool(pools[i].set, header->next_index);
+	}
+	if (!valid) {
+		SDL_Log("Snapshot %s is damaged", path);
+		for (int i = 0; i < pool_count; i++) {
+			entity_set_free(pools[i].set);
+		}
+		free_entities(entities);
+		snapshot_unmap(mapping);
+		return false;
+	}
+	return true;
+}
+
+#endif // ECS_BACKEND_ARCHETYPE
+
+#endif // SNAPSHOT_H
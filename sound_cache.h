@@ -0,0 +1,119 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decoded sound assets shared between entities. A .wav file is loaded and
+// converted to float samples at the output device's rate and channel count
+// the first time it is acquired; later acquisitions of the same file name
+// share the same read-only PCM buffer. Assets are reference counted, but one
+// whose last reference is released stays decoded: sounds like the oxygenator
+// refill are dropped and acquired again all the time, and must not go back to
+// disk each time. Unreferenced assets are freed by sound_cache_trim or with the
+// cache.
+#define SOUND_CACHE_NAME_LENGTH 64
+
+typedef struct SoundAsset {
+	char fname[SOUND_CACHE_NAME_LENGTH];
+	uint8_t* data;
+	uint32_t length;
+	int references;
+} SoundAsset;
+
+typedef struct SoundCache {
+	// format every asset is converted to
+	SDL_AudioSpec spec;
+	char* directory;
+	// assets are allocated one by one so handed out pointers stay valid
+	SoundAsset** assets;
+	int count;
+	int capacity;
+} SoundCache;
+
+bool sound_cache_init(SoundCache* cache, SDL_AudioDeviceID device, const char* directory) {
+	if (!SDL_GetAudioDeviceFormat(device, &cache->spec, NULL)) {
+		SDL_Log("Could not query audio device format: %s", SDL_GetError());
+		return false;
+	}
+	// the mixer works on float samples
+	cache->spec.format = SDL_AUDIO_F32;
+	cache->directory = SDL_strdup(directory);
+	return true;
+}
+
+SoundAsset* sound_cache_acquire(SoundCache* cache, const char* fname) {
+	for (int i = 0; i < cache->count; i++) {
+		if (strcmp(cache->assets[i]->fname, fname) == 0) {
+			cache->assets[i]->references++;
+			return cache->assets[i];
+		}
+	}
+
+	char* wav_path = NULL;
+	SDL_AudioSpec wav_spec;
+	uint8_t* wav_data = NULL;
+	uint32_t wav_data_len = 0;
+	SDL_asprintf(&wav_path, "%s%s", cache->directory, fname);
+	bool loaded = SDL_LoadWAV(wav_path, &wav_spec, &wav_data, &wav_data_len);
+	SDL_free(wav_path);
+	if (!loaded) {
+		SDL_Log("Could not load .wav file: %s", SDL_GetError());
+		return NULL;
+	}
+
+	SoundAsset* asset = calloc(1, sizeof(SoundAsset));
+	assert(asset != NULL);
+	int converted_len = 0;
+	bool converted = SDL_ConvertAudioSamples(&wav_spec, wav_data, wav_data_len, &cache->spec, &asset->data, &converted_len);
+	SDL_free(wav_data);
+	if (!converted) {
+		SDL_Log("Could not convert %s to the mixer format: %s", fname, SDL_GetError());
+		free(asset);
+		return NULL;
+	}
+	SDL_snprintf(asset->fname, sizeof(asset->fname), "%s", fname);
+	asset->length = converted_len;
+	asset->references = 1;
+
+	if (cache->count == cache->capacity) {
+		cache->capacity = cache->capacity ? cache->capacity * 2 : 8;
+		cache->assets = realloc(cache->assets, cache->capacity * sizeof(SoundAsset*));
+		assert(cache->assets != NULL);
+	}
+	cache->assets[cache->count++] = asset;
+	return asset;
+}
+
+void sound_cache_release(SoundCache* cache, SoundAsset* asset) {
+	if (asset != NULL) {
+		assert(asset->references > 0);
+		asset->references--;
+	}
+}
+
+// frees every asset nothing holds any more.
+void sound_cache_trim(SoundCache* cache) {
+	for (int i = cache->count - 1; i > -1; i--) {
+		SoundAsset* asset = cache->assets[i];
+		if (asset->references == 0) {
+			cache->assets[i] = cache->assets[--cache->count];
+			SDL_free(asset->data);
+			free(asset);
+		}
+	}
+}
+
+void sound_cache_free(SoundCache* cache) {
+	for (int i = 0; i < cache->count; i++) {
+		SDL_free(cache->assets[i]->data);
+		free(cache->assets[i]);
+	}
+	free(cache->assets);
+	SDL_free(cache->directory);
+	memset(cache, 0, sizeof(*cache));
+}
+
+#endif // SOUND_CACHE_H
@@ -0,0 +1,288 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aabb.h"
+#include "ecs.h"
+
+// Uniform grid broadphase for axis aligned boxes. Space is cut into square
+// cells of `cell_size` and every box is filed under each cell it touches;
+// cells are hashed into a power of two bucket table so the grid is unbounded.
+// The grid is rebuilt every tick with a counting sort into buffers that are
+// kept between ticks:
+//
+//	spatial_hash_clear(&grid);
+//	spatial_hash_insert(&grid, e, x, y, w, h);	// for every box
+//	spatial_hash_build(&grid);
+//	SpatialQuery q = spatial_hash_query(&grid, x, y, w, h);
+//	while (spatial_query_next(&q)) { q.entity, q.box ... }
+//
+// Overlap is inclusive of touching edges, matching `overlaps_pos_dim`.
+//
+// Boxes and cell entries are kept as structure-of-arrays columns. Entries are
+// sorted by bucket and carry a copy of their box, so a query tests a whole
+// bucket with the `aabb_overlap_mask` kernel and only walks the hits.
+#define SPATIAL_HASH_DEFAULT_CELL_SIZE 64.0f
+#define SPATIAL_HASH_MIN_BUCKETS 64
+
+typedef struct SpatialHash {
+	float cell_size;
+	// boxes in insertion order
+	float* x;
+	float* y;
+	float* w;
+	float* h;
+	Entity* entities;
+	// set by callers to flag a box (e.g. as consumed); cleared by build.
+	bool* marked;
+	uint32_t box_count;
+	uint32_t box_capacity;
+	// one entry per (box, cell) in bucket order
+	float* entry_x;
+	float* entry_y;
+	float* entry_w;
+	float* entry_h;
+	int32_t* entry_cell_x;
+	int32_t* entry_cell_y;
+	uint32_t* entry_box;
+	uint32_t entry_count;
+	uint32_t entry_capacity;
+	// bucket b holds entries [bucket_start[b], bucket_start[b + 1])
+	uint32_t* bucket_start;
+	uint32_t bucket_count;
+} SpatialHash;
+
+typedef struct SpatialQuery {
+	const SpatialHash* hash;
+	float x;
+	float y;
+	float w;
+	float h;
+	int32_t min_cell_x;
+	int32_t min_cell_y;
+	int32_t max_cell_x;
+	int32_t max_cell_y;
+	int32_t cell_x;
+	int32_t cell_y;
+	uint32_t cursor;
+	uint32_t end;
+	uint32_t batch_start;
+	uint32_t batch_hits;
+	uint32_t box;
+	Entity entity;
+} SpatialQuery;
+
+int32_t spatial_cell(float v, float cell_size) {
+	float f = v / cell_size;
+	int32_t i = (int32_t)f;
+	return i - (f < i);
+}
+
+uint32_t spatial_bucket(const SpatialHash* hash, int32_t cell_x, int32_t cell_y) {
+	uint32_t h = ((uint32_t)cell_x * 73856093u) ^ ((uint32_t)cell_y * 19349663u);
+	return h & (hash->bucket_count - 1);
+}
+
+void spatial_hash_clear(SpatialHash* hash) {
+	if (hash->cell_size <= 0) {
+		hash->cell_size = SPATIAL_HASH_DEFAULT_CELL_SIZE;
+	}
+	hash->box_count = 0;
+	hash->entry_count = 0;
+}
+
+void spatial_hash_insert(SpatialHash* hash, Entity e, float x, float y, float w, float h) {
+	if (hash->box_count == hash->box_capacity) {
+		uint32_t capacity = hash->box_capacity ? hash->box_capacity * 2 : 64;
+		hash->x = realloc(hash->x, capacity * sizeof(float));
+		hash->y = realloc(hash->y, capacity * sizeof(float));
+		hash->w = realloc(hash->w, capacity * sizeof(float));
+		hash->h = realloc(hash->h, capacity * sizeof(float));
+		hash->entities = realloc(hash->entities, capacity * sizeof(Entity));
+		hash->marked = realloc(hash->marked, capacity * sizeof(bool));
+		assert(hash->x != NULL && hash->y != NULL && hash->w != NULL && hash->h != NULL);
+		assert(hash->entities != NULL && hash->marked != NULL);
+		hash->box_capacity = capacity;
+	}
+	uint32_t i = hash->box_count++;
+	hash->x[i] = x;
+	hash->y[i] = y;
+	hash->w[i] = w;
+	hash->h[i] = h;
+	hash->entities[i] = e;
+}
+
+void spatial_hash_build(SpatialHash* hash) {
+	uint32_t bucket_count = SPATIAL_HASH_MIN_BUCKETS;
+	while (bucket_count < hash->box_count * 2) {
+		bucket_count *= 2;
+	}
+	if (bucket_count > hash->bucket_count) {
+		hash->bucket_start = realloc(hash->bucket_start, (bucket_count + 1) * sizeof(uint32_t));
+		assert(hash->bucket_start != NULL);
+	}
+	hash->bucket_count = bucket_count;
+	memset(hash->bucket_start, 0, (bucket_count + 1) * sizeof(uint32_t));
+	if (hash->box_count > 0) {
+		memset(hash->marked, 0, hash->box_count * sizeof(bool));
+	}
+
+	// count the entries of every bucket, shifted by one for the prefix sum
+	uint32_t entry_count = 0;
+	for (uint32_t i = 0; i < hash->box_count; i++) {
+		int32_t x1 = spatial_cell(hash->x[i] + hash->w[i], hash->cell_size);
+		int32_t y1 = spatial_cell(hash->y[i] + hash->h[i], hash->cell_size);
+		for (int32_t cy = spatial_cell(hash->y[i], hash->cell_size); cy <= y1; cy++) {
+			for (int32_t cx = spatial_cell(hash->x[i], hash->cell_size); cx <= x1; cx++) {
+				hash->bucket_start[spatial_bucket(hash, cx, cy) + 1]++;
+				entry_count++;
+			}
+		}
+	}
+	for (uint32_t b = 0; b < bucket_count; b++) {
+		hash->bucket_start[b + 1] += hash->bucket_start[b];
+	}
+
+	if (entry_count > hash->entry_capacity) {
+		hash->entry_x = realloc(hash->entry_x, entry_count * sizeof(float));
+		hash->entry_y = realloc(hash->entry_y, entry_count * sizeof(float));
+		hash->entry_w = realloc(hash->entry_w, entry_count * sizeof(float));
+		hash->entry_h = realloc(hash->entry_h, entry_count * sizeof(float));
+		hash->entry_cell_x = realloc(hash->entry_cell_x, entry_count * sizeof(int32_t));
+		hash->entry_cell_y = realloc(hash->entry_cell_y, entry_count * sizeof(int32_t));
+		hash->entry_box = realloc(hash->entry_box, entry_count * sizeof(uint32_t));
+		assert(hash->entry_x != NULL && hash->entry_y != NULL && hash->entry_w != NULL && hash->entry_h != NULL);
+		assert(hash->entry_cell_x != NULL && hash->entry_cell_y != NULL && hash->entry_box != NULL);
+		hash->entry_capacity = entry_count;
+	}
+	hash->entry_count = entry_count;
+
+	// scatter, using bucket_start[b] as the write cursor of bucket b
+	for (uint32_t i = 0; i < hash->box_count; i++) {
+		int32_t x1 = spatial_cell(hash->x[i] + hash->w[i], hash->cell_size);
+		int32_t y1 = spatial_cell(hash->y[i] + hash->h[i], hash->cell_size);
+		for (int32_t cy = spatial_cell(hash->y[i], hash->cell_size); cy <= y1; cy++) {
+			for (int32_t cx = spatial_cell(hash->x[i], hash->cell_size); cx <= x1; cx++) {
+				uint32_t entry = hash->bucket_start[spatial_bucket(hash, cx, cy)]++;
+				hash->entry_x[entry] = hash->x[i];
+				hash->entry_y[entry] = hash->y[i];
+				hash->entry_w[entry] = hash->w[i];
+				hash->entry_h[entry] = hash->h[i];
+				hash->entry_cell_x[entry] = cx;
+				hash->entry_cell_y[entry] = cy;
+				hash->entry_box[entry] = i;
+			}
+		}
+	}
+	// the scatter advanced every start to the next bucket's start; shift back
+	memmove(hash->bucket_start + 1, hash->bucket_start, bucket_count * sizeof(uint32_t));
+	hash->bucket_start[0] = 0;
+}
+
+void spatial_query_enter_cell(SpatialQuery* q) {
+	uint32_t b = spatial_bucket(q->hash, q->cell_x, q->cell_y);
+	q->cursor = q->hash->bucket_start[b];
+	q->end = q->hash->bucket_start[b + 1];
+	q->batch_hits = 0;
+}
+
+SpatialQuery spatial_hash_query(const SpatialHash* hash, float x, float y, float w, float h) {
+	SpatialQuery q = {
+		.hash = hash,
+		.x = x,
+		.y = y,
+		.w = w,
+		.h = h,
+		.entity = NULL_ENTITY,
+	};
+	if (hash->box_count == 0) {
+		q.min_cell_y = 1;
+		return q;
+	}
+	q.min_cell_x = spatial_cell(x, hash->cell_size);
+	q.min_cell_y = spatial_cell(y, hash->cell_size);
+	q.max_cell_x = spatial_cell(x + w, hash->cell_size);
+	q.max_cell_y = spatial_cell(y + h, hash->cell_size);
+	q.cell_x = q.min_cell_x;
+	q.cell_y = q.min_cell_y;
+	spatial_query_enter_cell(&q);
+	return q;
+}
+
+// Yields every indexed box overlapping the query box exactly once. A box
+// spanning several cells is only reported from the first cell it shares with
+// the query, so no visited set is needed.
+bool spatial_query_next(SpatialQuery* q) {
+	const SpatialHash* hash = q->hash;
+	while (q->cell_y <= q->max_cell_y) {
+		for (;;) {
+			if (q->batch_hits == 0) {
+				if (q->cursor >= q->end) {
+					break;
+				}
+				uint32_t n = q->end - q->cursor < AABB_BATCH ? q->end - q->cursor : AABB_BATCH;
+				q->batch_start = q->cursor;
+				q->batch_hits = aabb_overlap_mask(q->x, q->y, q->w, q->h,
+					hash->entry_x + q->cursor, hash->entry_y + q->cursor,
+					hash->entry_w + q->cursor, hash->entry_h + q->cursor, n);
+				q->cursor += n;
+				continue;
+			}
+			uint32_t entry = q->batch_start + __builtin_ctz(q->batch_hits);
+			q->batch_hits &= q->batch_hits - 1;
+			// buckets are shared by every cell that hashes to them
+			if (hash->entry_cell_x[entry] != q->cell_x || hash->entry_cell_y[entry] != q->cell_y) {
+				continue;
+			}
+			int32_t first_x = spatial_cell(hash->entry_x[entry], hash->cell_size);
+			int32_t first_y = spatial_cell(hash->entry_y[entry], hash->cell_size);
+			if (first_x < q->min_cell_x) {
+				first_x = q->min_cell_x;
+			}
+			if (first_y < q->min_cell_y) {
+				first_y = q->min_cell_y;
+			}
+			if (first_x != q->cell_x || first_y != q->cell_y) {
+				continue;
+			}
+			q->box = hash->entry_box[entry];
+			q->entity = hash->entities[q->box];
+			return true;
+		}
+		if (++q->cell_x > q->max_cell_x) {
+			q->cell_x = q->min_cell_x;
+			if (++q->cell_y > q->max_cell_y) {
+				break;
+			}
+		}
+		spatial_query_enter_cell(q);
+	}
+	return false;
+}
+
+void spatial_hash_free(SpatialHash* hash) {
+	free(hash->x);
+	free(hash->y);
+	free(hash->w);
+	free(hash->h);
+	free(hash->entities);
+	free(hash->marked);
+	free(hash->entry_x);
+	free(hash->entry_y);
+	free(hash->entry_w);
+	free(hash->entry_h);
+	free(hash->entry_cell_x);
+	free(hash->entry_cell_y);
+	free(hash->entry_box);
+	free(hash->bucket_start);
+	float cell_size = hash->cell_size;
+	memset(hash, 0, sizeof(*hash));
+	hash->cell_size = cell_size;
+}
+
+#endif // SPATIAL_HASH_H
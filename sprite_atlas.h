@@ -0,0 +1,176 @@
+#ifndef SPRITE_ATLAS_H
+#define SPRITE_ATLAS_H
+
+#include <SDL3/SDL.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quad_batch.h"
+
+// Every .bmp in a directory is packed at startup into a few large atlas
+// pages (shelf packing, tallest first). Magenta (255, 0, 255) is transparent,
+// as it was for the individual sprite textures. A sprite is the index of its
+// region, and every frame all sprite quads are submitted with one
+// SDL_RenderGeometry call per page.
+#define SPRITE_ATLAS_PAGE_SIZE 1024
+#define SPRITE_ATLAS_MAX_PAGES 4
+#define SPRITE_ATLAS_PADDING 1
+#define SPRITE_ATLAS_NAME_LENGTH 64
+
+typedef struct SpriteRegion {
+	char name[SPRITE_ATLAS_NAME_LENGTH];
+	int page;
+	SDL_Rect rect;
+	// normalised texture coordinates of `rect`
+	SDL_FRect uv;
+} SpriteRegion;
+
+typedef struct SpriteAtlas {
+	SDL_Texture* pages[SPRITE_ATLAS_MAX_PAGES];
+	QuadBatch batches[SPRITE_ATLAS_MAX_PAGES];
+	int page_count;
+	SpriteRegion* regions;
+	int region_count;
+} SpriteAtlas;
+
+typedef struct SpriteAtlasImage {
+	const char* name;
+	SDL_Surface* surface;
+} SpriteAtlasImage;
+
+int sprite_atlas_compare_height(const void* a, const void* b) {
+	return ((const SpriteAtlasImage*)b)->surface->h - ((const SpriteAtlasImage*)a)->surface->h;
+}
+
+bool sprite_atlas_build(SpriteAtlas* atlas, const char* directory, SDL_Renderer* p_sdl_renderer) {
+	int file_count = 0;
+	char** files = SDL_GlobDirectory(directory, "*.bmp", 0, &file_count);
+	if (files == NULL) {
+		SDL_Log("Could not list sprites in %s: %s", directory, SDL_GetError());
+		return false;
+	}
+
+	SpriteAtlasImage* images = calloc(file_count ? file_count : 1, sizeof(SpriteAtlasImage));
+	atlas->regions = calloc(file_count ? file_count : 1, sizeof(SpriteRegion));
+	assert(images != NULL && atlas->regions != NULL);
+	int image_count = 0;
+	for (int i = 0; i < file_count; i++) {
+		char* path = NULL;
+		SDL_asprintf(&path, "%s%s", directory, files[i]);
+		SDL_Surface* p_surface = SDL_LoadBMP(path);
+		SDL_free(path);
+		if (p_surface == NULL) {
+			SDL_Log("Could not load .bmp file: %s", SDL_GetError());
+			continue;
+		}
+		if (p_surface->w > SPRITE_ATLAS_PAGE_SIZE || p_surface->h > SPRITE_ATLAS_PAGE_SIZE) {
+			SDL_Log("Sprite %s does not fit in a %d atlas page", files[i], SPRITE_ATLAS_PAGE_SIZE);
+			SDL_DestroySurface(p_surface);
+			continue;
+		}
+		Uint32 colorkey = SDL_MapRGB(SDL_GetPixelFormatDetails(p_surface->format), NULL, 255, 0, 255);
+		SDL_SetSurfaceColorKey(p_surface, true, colorkey);
+		SDL_SetSurfaceBlendMode(p_surface, SDL_BLENDMODE_NONE);
+		images[image_count++] = (SpriteAtlasImage) { .name = files[i], .surface = p_surface };
+	}
+	qsort(images, image_count, sizeof(SpriteAtlasImage), sprite_atlas_compare_height);
+
+	// pages start fully transparent so the colour keyed pixels stay clear
+	SDL_Surface* pages[SPRITE_ATLAS_MAX_PAGES] = {0};
+	int shelf_x = SPRITE_ATLAS_PAGE_SIZE;
+	int shelf_y = 0;
+	int shelf_height = 0;
+	bool result = true;
+	for (int i = 0; i < image_count; i++) {
+		SDL_Surface* p_surface = images[i].surface;
+		if (shelf_x + p_surface->w > SPRITE_ATLAS_PAGE_SIZE) {
+			shelf_x = 0;
+			shelf_y += shelf_height;
+			shelf_height = 0;
+		}
+		if (atlas->page_count == 0 || shelf_y + p_surface->h > SPRITE_ATLAS_PAGE_SIZE) {
+			if (atlas->page_count == SPRITE_ATLAS_MAX_PAGES) {
+				SDL_Log("Sprite atlas is full, skipping %s", images[i].name);
+				result = false;
+				break;
+			}
+			pages[atlas->page_count] = SDL_CreateSurface(SPRITE_ATLAS_PAGE_SIZE, SPRITE_ATLAS_PAGE_SIZE, SDL_PIXELFORMAT_RGBA32);
+			if (pages[atlas->page_count] == NULL) {
+				SDL_Log("Could not create atlas page: %s", SDL_GetError());
+				result = false;
+				break;
+			}
+			atlas->page_count++;
+			shelf_x = 0;
+			shelf_y = 0;
+			shelf_height = 0;
+		}
+		SpriteRegion* region = &atlas->regions[atlas->region_count++];
+		SDL_snprintf(region->name, sizeof(region->name), "%s", images[i].name);
+		region->page = atlas->page_count - 1;
+		region->rect = (SDL_Rect) { .x = shelf_x, .y = shelf_y, .w = p_surface->w, .h = p_surface->h };
+		region->uv = (SDL_FRect) {
+			.x = (float)region->rect.x / SPRITE_ATLAS_PAGE_SIZE,
+			.y = (float)region->rect.y / SPRITE_ATLAS_PAGE_SIZE,
+			.w = (float)region->rect.w / SPRITE_ATLAS_PAGE_SIZE,
+			.h = (float)region->rect.h / SPRITE_ATLAS_PAGE_SIZE,
+		};
+		SDL_BlitSurface(p_surface, NULL, pages[region->page], &region->rect);
+		shelf_x += p_surface->w + SPRITE_ATLAS_PADDING;
+		if (p_surface->h + SPRITE_ATLAS_PADDING > shelf_height) {
+			shelf_height = p_surface->h + SPRITE_ATLAS_PADDING;
+		}
+	}
+
+	for (int page = 0; page < atlas->page_count; page++) {
+		atlas->pages[page] = SDL_CreateTextureFromSurface(p_sdl_renderer, pages[page]);
+		if (atlas->pages[page] == NULL) {
+			SDL_Log("Could not create atlas texture: %s", SDL_GetError());
+			result = false;
+		}
+		SDL_DestroySurface(pages[page]);
+	}
+	for (int i = 0; i < image_count; i++) {
+		SDL_DestroySurface(images[i].surface);
+	}
+	free(images);
+	SDL_free(files);
+	SDL_Log("Packed %d sprites into %d atlas page(s)", atlas->region_count, atlas->page_count);
+	return result;
+}
+
+// returns the region index of the sprite loaded from `name`, or -1.
+int sprite_atlas_find(const SpriteAtlas* atlas, const char* name) {
+	for (int i = 0; i < atlas->region_count; i++) {
+		if (strcmp(atlas->regions[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void sprite_atlas_push(SpriteAtlas* atlas, int region, const SDL_FRect* dst) {
+	if (region < 0 || region >= atlas->region_count) {
+		return;
+	}
+	SpriteRegion* p_region = &atlas->regions[region];
+	quad_batch_push(&atlas->batches[p_region->page], dst, (SDL_FColor) { 1.0f, 1.0f, 1.0f, 1.0f }, &p_region->uv);
+}
+
+void sprite_atlas_flush(SpriteAtlas* atlas, SDL_Renderer* p_sdl_renderer) {
+	for (int page = 0; page < atlas->page_count; page++) {
+		quad_batch_flush(&atlas->batches[page], p_sdl_renderer, atlas->pages[page]);
+	}
+}
+
+void sprite_atlas_free(SpriteAtlas* atlas) {
+	for (int page = 0; page < atlas->page_count; page++) {
+		SDL_DestroyTexture(atlas->pages[page]);
+		quad_batch_free(&atlas->batches[page]);
+	}
+	free(atlas->regions);
+	memset(atlas, 0, sizeof(*atlas));
+}
+
+#endif // SPRITE_ATLAS_H
@@ -0,0 +1,187 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <SDL3/SDL.h>
+#include <SDL3_ttf/SDL_ttf.h>
+#include <string.h>
+
+#include "quad_batch.h"
+
+// Text rendering without per-frame rasterisation, in two flavours:
+//
+// Dynamic text (the HUD counters) is laid out from a glyph atlas. The
+// printable ASCII glyphs of the font are rasterised in white into one texture
+// at startup; text_draw queues a tinted quad per character and text_flush
+// submits every queued string with one geometry call.
+//
+// Static strings (overlays like "PAUSED") are rendered whole, once, and the
+// texture is cached by (text, size, colour). The cache owns the textures;
+// when it is full the oldest entry is replaced.
+#define TEXT_FIRST_GLYPH 32
+#define TEXT_LAST_GLYPH 126
+#define TEXT_GLYPH_COUNT (TEXT_LAST_GLYPH - TEXT_FIRST_GLYPH + 1)
+#define TEXT_ATLAS_SIZE 512
+#define TEXT_CACHE_CAPACITY 16
+#define TEXT_MAX_LENGTH 64
+
+typedef struct TextGlyph {
+	SDL_FRect uv;
+	float width;
+	float height;
+	float advance;
+} TextGlyph;
+
+typedef struct TextCacheEntry {
+	char text[TEXT_MAX_LENGTH];
+	float size;
+	SDL_Color color;
+	SDL_Texture* texture;
+} TextCacheEntry;
+
+typedef struct TextRenderer {
+	TTF_Font* font;
+	float font_size;
+	float line_height;
+	SDL_Texture* glyph_atlas;
+	TextGlyph glyphs[TEXT_GLYPH_COUNT];
+	QuadBatch batch;
+	TextCacheEntry entries[TEXT_CACHE_CAPACITY];
+	int entry_count;
+	int next_eviction;
+} TextRenderer;
+
+bool text_init(TextRenderer* text, TTF_Font* font, SDL_Renderer* p_sdl_renderer) {
+	memset(text, 0, sizeof(*text));
+	text->font = font;
+	text->font_size = TTF_GetFontSize(font);
+	text->line_height = (float)TTF_GetFontHeight(font);
+
+	SDL_Surface* atlas = SDL_CreateSurface(TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, SDL_PIXELFORMAT_RGBA32);
+	if (atlas == NULL) {
+		SDL_Log("Could not create glyph atlas: %s", SDL_GetError());
+		return false;
+	}
+	const SDL_Color white = { 255, 255, 255, SDL_ALPHA_OPAQUE };
+	int pen_x = 0;
+	int pen_y = 0;
+	int row_height = 0;
+	for (int i = 0; i < TEXT_GLYPH_COUNT; i++) {
+		Uint32 codepoint = TEXT_FIRST_GLYPH + i;
+		TextGlyph* glyph = &text->glyphs[i];
+		int min_x, max_x, min_y, max_y, advance;
+		if (!TTF_GetGlyphMetrics(font, codepoint, &min_x, &max_x, &min_y, &max_y, &advance)) {
+			continue;
+		}
+		glyph->advance = (float)advance;
+		SDL_Surface* p_surface = TTF_RenderGlyph_Blended(font, codepoint, white);
+		if (p_surface == NULL) {
+			// blank glyphs like the space only advance the pen
+			continue;
+		}
+		if (pen_x + p_surface->w > TEXT_ATLAS_SIZE) {
+			pen_x = 0;
+			pen_y += row_height + 1;
+			row_height = 0;
+		}
+		if (pen_y + p_surface->h > TEXT_ATLAS_SIZE) {
+			SDL_Log("Glyph atlas is full at '%c'", (char)codepoint);
+			SDL_DestroySurface(p_surface);
+			break;
+		}
+		SDL_SetSurfaceBlendMode(p_surface, SDL_BLENDMODE_NONE);
+		SDL_Rect rect = { .x = pen_x, .y = pen_y, .w = p_surface->w, .h = p_surface->h };
+		SDL_BlitSurface(p_surface, NULL, atlas, &rect);
+		glyph->uv = (SDL_FRect) {
+			.x = (float)rect.x / TEXT_ATLAS_SIZE,
+			.y = (float)rect.y / TEXT_ATLAS_SIZE,
+			.w = (float)rect.w / TEXT_ATLAS_SIZE,
+			.h = (float)rect.h / TEXT_ATLAS_SIZE,
+		};
+		glyph->width = (float)rect.w;
+		glyph->height = (float)rect.h;
+		pen_x += rect.w + 1;
+		if (rect.h > row_height) {
+			row_height = rect.h;
+		}
+		SDL_DestroySurface(p_surface);
+	}
+	text->glyph_atlas = SDL_CreateTextureFromSurface(p_sdl_renderer, atlas);
+	SDL_DestroySurface(atlas);
+	if (text->glyph_atlas == NULL) {
+		SDL_Log("Could not create glyph atlas texture: %s", SDL_GetError());
+		return false;
+	}
+	SDL_SetTextureBlendMode(text->glyph_atlas, SDL_BLENDMODE_BLEND);
+	return true;
+}
+
+// queues `string` with its top left corner at (x, y); characters outside printable ASCII are skipped.
+void text_draw(TextRenderer* text, const char* string, float x, float y, SDL_FColor color) {
+	float pen_x = x;
+	for (const char* c = string; *c != '\0'; c++) {
+		int i = (unsigned char)*c - TEXT_FIRST_GLYPH;
+		if (i < 0 || i >= TEXT_GLYPH_COUNT) {
+			continue;
+		}
+		TextGlyph* glyph = &text->glyphs[i];
+		if (glyph->width > 0) {
+			quad_batch_push(&text->batch, &(SDL_FRect) { .x = pen_x, .y = y, .w = glyph->width, .h = glyph->height }, color, &glyph->uv);
+		}
+		pen_x += glyph->advance;
+	}
+}
+
+void text_flush(TextRenderer* text, SDL_Renderer* p_sdl_renderer) {
+	quad_batch_flush(&text->batch, p_sdl_renderer, text->glyph_atlas);
+}
+
+// returns a texture of `string` rendered at `size`, rasterising it only the first time.
+SDL_Texture* text_texture(TextRenderer* text, SDL_Renderer* p_sdl_renderer, const char* string, float size, SDL_Color color) {
+	for (int i = 0; i < text->entry_count; i++) {
+		TextCacheEntry* entry = &text->entries[i];
+		if (entry->size == size && memcmp(&entry->color, &color, sizeof(color)) == 0 && strcmp(entry->text, string) == 0) {
+			return entry->texture;
+		}
+	}
+	if (strlen(string) >= TEXT_MAX_LENGTH) {
+		SDL_Log("Text is too long to cache: %s", string);
+		return NULL;
+	}
+
+	TTF_SetFontSize(text->font, size);
+	SDL_Surface* p_surface = TTF_RenderText_Blended(text->font, string, 0, color);
+	TTF_SetFontSize(text->font, text->font_size);
+	if (p_surface == NULL) {
+		return NULL;
+	}
+	SDL_Texture* texture = SDL_CreateTextureFromSurface(p_sdl_renderer, p_surface);
+	SDL_DestroySurface(p_surface);
+	if (texture == NULL) {
+		return NULL;
+	}
+
+	TextCacheEntry* entry;
+	if (text->entry_count < TEXT_CACHE_CAPACITY) {
+		entry = &text->entries[text->entry_count++];
+	} else {
+		entry = &text->entries[text->next_eviction];
+		text->next_eviction = (text->next_eviction + 1) % TEXT_CACHE_CAPACITY;
+		SDL_DestroyTexture(entry->texture);
+	}
+	SDL_snprintf(entry->text, sizeof(entry->text), "%s", string);
+	entry->size = size;
+	entry->color = color;
+	entry->texture = texture;
+	return texture;
+}
+
+void text_free(TextRenderer* text) {
+	for (int i = 0; i < text->entry_count; i++) {
+		SDL_DestroyTexture(text->entries[i].texture);
+	}
+	SDL_DestroyTexture(text->glyph_atlas);
+	quad_batch_free(&text->batch);
+	memset(text, 0, sizeof(*text));
+}
+
+#endif // TEXT_H
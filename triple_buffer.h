@@ -0,0 +1,40 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <SDL3/SDL.h>
+
+// Lock free hand-off of whole values between one producer and one consumer
+// thread. The caller owns three slots; the producer writes into slot `back`
+// and publishes it, the consumer reads slot `front` after acquiring the
+// latest published one. Neither side ever waits: a producer that outruns the
+// consumer just replaces the unread slot.
+#define TRIPLE_BUFFER_FRESH 4
+
+typedef struct TripleBuffer {
+	// slot last published, with TRIPLE_BUFFER_FRESH set until it is acquired
+	SDL_AtomicInt ready;
+	int back;
+	int front;
+} TripleBuffer;
+
+void triple_buffer_init(TripleBuffer* buffer) {
+	buffer->back = 0;
+	SDL_SetAtomicInt(&buffer->ready, 1);
+	buffer->front = 2;
+}
+
+// publishes slot `back` and returns the slot to write next.
+int triple_buffer_publish(TripleBuffer* buffer) {
+	buffer->back = SDL_SetAtomicInt(&buffer->ready, buffer->back | TRIPLE_BUFFER_FRESH) & 3;
+	return buffer->back;
+}
+
+// returns the most recently published slot, or the current one if nothing new was published.
+int triple_buffer_acquire(TripleBuffer* buffer) {
+	if (SDL_GetAtomicInt(&buffer->ready) & TRIPLE_BUFFER_FRESH) {
+		buffer->front = SDL_SetAtomicInt(&buffer->ready, buffer->front) & 3;
+	}
+	return buffer->front;
+}
+
+#endif // TRIPLE_BUFFER_H
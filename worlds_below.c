@@ -3,10 +3,25 @@
 #include <SDL3_ttf/SDL_ttf.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
 
+#include "aabb.h"
+#include "arena.h"
 #include "ecs.h"
+#include "jobs.h"
+#include "mixer.h"
+#include "music_stream.h"
+#include "profiler.h"
+#include "quad_batch.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "sound_cache.h"
+#include "spatial_hash.h"
+#include "sprite_atlas.h"
+#include "text.h"
+#include "triple_buffer.h"
 
 #define min(a,b)  \
 ({ __typeof__ (a) _a = (a); \
@@ -20,9 +35,20 @@ _a > _b ? _a : _b; })
 
 const int MAX_HEALTH = 100;
 const int NANO_SECONDS_PER_SECOND = 1000000000;
-
+// The simulation advances in fixed steps of 1/SIMULATION_HZ seconds, as many
+// as fit into the time that has passed; rendering interpolates between the
+// last two steps. After a long stall at most MAX_SIMULATION_STEPS_PER_FRAME
+// steps are run and the rest of the backlog is dropped.
+#ifndef SIMULATION_HZ
+#define SIMULATION_HZ 60
+#endif
+#define MAX_SIMULATION_STEPS_PER_FRAME 5
+
+#if !defined(WORLDS_BELOW_NO_MAIN)
 static SDL_Texture *texture = NULL;
 static TTF_Font *font = NULL;
+static TextRenderer text_renderer;
+#endif
 static SDL_AudioDeviceID audio_device = 0;
 
 extern unsigned char tiny_ttf[];
@@ -53,7 +79,6 @@ typedef struct c_color {
 	int green;
 	int blue;
 } c_color;
-typedef bool c_oxygenator;
 typedef float c_health;
 typedef struct c_dimension {
 	float width;
@@ -67,33 +92,50 @@ typedef struct c_position {
 typedef SDL_FRect c_boundingBox;
 typedef struct c_sound {
 	const char* fname;
-	uint8_t* wav_data;
-	uint32_t wav_data_len;
-	SDL_AudioStream* stream;
+	// shared PCM in the mixer format, owned by the sound cache
+	SoundAsset* asset;
+	// long tracks are streamed from disk instead of cached
+	bool streamed;
+	MusicStream* music;
+	MixerVoiceId voice;
+	// voices are stolen from lower priority sounds first
+	int priority;
 	bool repeat;
 	bool played;
 } c_sound;
-typedef bool c_containable;
 typedef struct c_container { 
 	Entity containables[10];
 	Entity count;
 } c_container;
-typedef SDL_Texture* c_sprite;
+// region index in the sprite atlas
+typedef int c_sprite;
 
 COMPONENT(Colors, c_color)
-// TODO: Understand the unnecesarry overhead of using the ecs macro for
-// these simple bool-type flags vs just an array of entity pointers
-COMPONENT(Containables, c_containable)
 COMPONENT(Containers, c_container)
 COMPONENT(Dimensions, c_dimension)
 COMPONENT(Healths, c_health)
-COMPONENT(Oxygenators, c_oxygenator)
 COMPONENT(Positions, c_position)
+// where each entity was at the start of the last simulation step
+COMPONENT(PreviousPositions, c_position)
 COMPONENT(Sounds, c_sound)
 COMPONENT(Sprites, c_sprite)
+// flags with no data are tags: a bit per entity instead of a full pool
+// the entity the background music plays on
+TAG_COMPONENT(BackgroundMusic)
+TAG_COMPONENT(Containables)
+TAG_COMPONENT(Oxygenators)
+TAG_COMPONENT(PlayerControlled)
 
 // Resources: Static assets that may be reused across components/systems
+static SoundCache sound_cache;
+static Mixer mixer;
 static c_sprite o2_tank_sprite;
+#if !defined(WORLDS_BELOW_NO_MAIN)
+static SpriteAtlas sprite_atlas;
+// scratch memory for the main loop, emptied at the start of every frame
+static Arena frame_arena;
+#define FRAME_ARENA_SIZE (256 * 1024)
+#endif
 
 // =======================================================================================
 //  ┌─┐┬ ┬┌─┐┌┬┐┌─┐┌┬┐┌─┐
@@ -104,138 +146,174 @@ static c_sprite o2_tank_sprite;
 //  where the system is named based on the data components required to operate the system,
 //  ideally in the same order as the parameters.
 //
-// TODO: there is probably some sort of optimization sampling I can add to every system
-// To make sure the component with the lowest count is always checked first.
-
-static bool init_bmp(const char* fname, SDL_Texture** p_texture, SDL_Renderer* p_sdl_renderer) {
-	char* sprite_path = NULL;
+// Systems that join several pools iterate them with QUERY (see ecs.h), which
+// always drives the loop from the pool with the lowest count.
 
-	SDL_asprintf(&sprite_path, "%sresources\\%s", SDL_GetBasePath(), fname);
-	SDL_Surface* p_surface = SDL_LoadBMP(sprite_path);
-
-	if(p_surface == NULL) {
-		SDL_Log("Could not load .bmp file: %s", SDL_GetError());
-		return false;
-	} else {
-		Uint32 colorkey = SDL_MapRGB(SDL_GetPixelFormatDetails(p_surface->format), NULL, 255, 0, 255);
-		SDL_SetSurfaceColorKey(p_surface, true, colorkey);
-		*p_texture = SDL_CreateTextureFromSurface(p_sdl_renderer, p_surface);
+// Without an audio device (headless) sounds stay silent: nothing is loaded
+// and sys_sound skips them.
+static bool init_sound(c_sound* sound) {
+	if (audio_device == 0) {
+		return true;
 	}
-
-	SDL_DestroySurface(p_surface);
-
-	if (*p_texture == NULL) {
-		SDL_Log("Could not create texture from .bmp file: %s", SDL_GetError());
-		return false;
+	if (sound->streamed) {
+		char* music_path = NULL;
+		SDL_asprintf(&music_path, "%s%s", sound_cache.directory, sound->fname);
+		sound->music = malloc(sizeof(MusicStream));
+		assert(sound->music != NULL);
+		bool opened = music_stream_open(sound->music, music_path, &sound_cache.spec, sound->repeat);
+		SDL_free(music_path);
+		if (!opened) {
+			free(sound->music);
+			sound->music = NULL;
+		}
+		return opened;
 	}
-
-	SDL_free(sprite_path);
-	return true;
+	sound->asset = sound_cache_acquire(&sound_cache, sound->fname);
+	return sound->asset != NULL;
 }
 
-static bool init_sound(c_sound* sound) {
-	bool result = false;
-	SDL_AudioSpec spec;
-	char* wav_path = NULL;
-
-	SDL_asprintf(&wav_path, "%sresources/%s", SDL_GetBasePath(), sound->fname);
-	if (!SDL_LoadWAV(wav_path, &spec, &sound->wav_data, &sound->wav_data_len)) {
-		SDL_Log("Could not load .wav file: %s", SDL_GetError());
-		return false;
+// must be called before a c_sound is removed or overwritten
+static void release_sound(c_sound* sound) {
+	mixer_stop(&mixer, sound->voice);
+	sound_cache_release(&sound_cache, sound->asset);
+	if (sound->music != NULL) {
+		music_stream_close(sound->music);
+		free(sound->music);
 	}
-
-	sound->stream = SDL_CreateAudioStream(&spec, NULL);
-	if (!sound->stream) {
-		SDL_Log("Failed to create audio stream: %s", SDL_GetError());
-	} else if (!SDL_BindAudioStream(audio_device, sound->stream)) {
-		SDL_Log("Failed to bind audio stream: %s", SDL_GetError());
-	} else {
-		result = true;
-	}
-
-	SDL_free(wav_path);
-	return result;
+	sound->voice = MIXER_NO_VOICE;
+	sound->asset = NULL;
+	sound->music = NULL;
 }
 
 bool overlaps_pos_dim(c_position* p_position_a, c_dimension* p_dimension_a, c_position* p_position_b, c_dimension* p_dimension_b) {
-	bool result = (
-			(p_position_a->x+p_dimension_a->width < p_position_b->x) ||
-			(p_position_b->x+p_dimension_b->width < p_position_a->x) ||
-			(p_position_a->y+p_dimension_a->height < p_position_b->y) ||
-			(p_position_b->y+p_dimension_b->height < p_position_a->y)
+	return aabb_overlaps(
+			p_position_a->x, p_position_a->y, p_dimension_a->width, p_dimension_a->height,
+			p_position_b->x, p_position_b->y, p_dimension_b->width, p_dimension_b->height
 		      );
-	return !result;
 }
 
+// Starts every sound that has not played yet, restarts repeating sounds
+// whose voice ended or was stolen and tops up streamed tracks.
 void sys_sound(Sounds* sounds) {
-	for(size_t i = 0; i < sounds->count; i++) {
-		c_sound* sound = &sounds->data[i];
-		if (!sound->repeat) {
-			if (!sound->played) {
-				SDL_PutAudioStreamData(sound->stream, sound->wav_data, sound->wav_data_len);
+	Query q = QUERY(sounds);
+	while(query_next(&q)) {
+		c_sound* sound = q.components[0];
+		if (sound->music != NULL) {
+			music_stream_refill(sound->music);
+			if (!sound->played || (sound->repeat && !mixer_playing(&mixer, sound->voice))) {
+				sound->voice = mixer_play_source(&mixer, music_stream_pull, sound->music, sound->priority);
 				sound->played = true;
 			}
+			continue;
+		}
+		if (sound->asset == NULL) {
+			continue;
 		}
-		else if (SDL_GetAudioStreamQueued(sound->stream) < sound->wav_data_len) {
+		if (!sound->played || (sound->repeat && !mixer_playing(&mixer, sound->voice))) {
+			sound->voice = mixer_play(&mixer, sound->asset->data, sound->asset->length, sound->priority, sound->repeat);
 			sound->played = true;
-			SDL_PutAudioStreamData(sound->stream, sound->wav_data, sound->wav_data_len);
 		}
-				
 	}
 }
 
-void sys_health_oxygenator_position_dimension_sound(long *p_time_since_last_tick, size_t *pEntityCount, Healths* healths, Oxygenators* oxygenators, Positions* positions, Dimensions* dimensions, Sounds* sounds) {
+// Rows per chunk of a parallel pass. Small enough that a chunk's components
+// stay in cache while it is processed, large enough that claiming chunks is
+// rare next to the work in them.
+#define PARALLEL_CHUNK_ROWS 1024
+
+typedef struct OxygenationPass {
+	SpatialHash* oxygenator_grid;
+	Healths* healths;
+	Positions* positions;
+	Dimensions* dimensions;
+	float delta;
+	// per worker, the grid boxes of oxygenators that someone is inside
+	JobBuffers* p_occupied;
+} OxygenationPass;
+
+void oxygenate_rows(int worker, int32_t begin, int32_t end, void* data) {
+	OxygenationPass* pass = data;
+	Query health_query = QUERY(pass->healths, pass->positions, pass->dimensions);
+	query_limit(&health_query, begin, end);
+	while(query_next(&health_query)) {
+		c_health *p_health = health_query.components[0];
+		c_position* p_position = health_query.components[1];
+		c_dimension* p_dimension = health_query.components[2];
+		bool o2_x_health = false;
+		SpatialQuery overlaps = spatial_hash_query(pass->oxygenator_grid, p_position->x, p_position->y, p_dimension->width, p_dimension->height);
+		while(spatial_query_next(&overlaps)) {
+			o2_x_health = true;
+			*(uint32_t*)job_buffers_push(pass->p_occupied, worker) = overlaps.box;
+		}
+		if(o2_x_health) {
+			*p_health = min(MAX_HEALTH, *p_health+pass->delta);
+		} else {
+			*p_health = max(0, *p_health-pass->delta);
+		}
+	}
+}
+
+// Every health entity inside an oxygenator recovers, every other one suffocates,
+// and an oxygenator plays its refill sound while anyone is inside it. Healths
+// are updated in parallel chunks; the occupied oxygenators each worker finds
+// are merged afterwards. Sounds are added and removed through `commands`.
+void sys_health_oxygenator_position_dimension_sound(JobSystem* jobs, int worker, CommandBuffer* commands, int writer, long *p_time_since_last_tick, SpatialHash* oxygenator_grid, JobBuffers* p_occupied, Healths* healths, Oxygenators* oxygenators, Positions* positions, Dimensions* dimensions, Sounds* sounds) {
 	const float O2_RECOVERY_RATE_PER_SECOND = 5;
 	const float O2_RECOVERY_RATE_PER_NANOSECOND = O2_RECOVERY_RATE_PER_SECOND / NANO_SECONDS_PER_SECOND;
 	float delta = (*p_time_since_last_tick) * O2_RECOVERY_RATE_PER_NANOSECOND;
 	
-	for(size_t j = 0; j < oxygenators->count; j++) {
-		Entity oxygenator_entity = oxygenators->entities[j];
-		bool o2_x_health = false;
-		for(size_t i = 0; i < healths->count; i++) {
-			Entity health_entity = healths->entities[i];
-			c_health *p_health = &healths->data[i];
-			c_position* p_position_a = get_Positions(positions, health_entity);
-			c_dimension* p_dimension_a = get_Dimensions(dimensions, health_entity);
-			bool bounding_box_with_health = (p_health != NULL && p_position_a != NULL && p_dimension_a);
-			if(bounding_box_with_health) {
-				bool oxygenatorAndHealthOverlap = false;
-				c_position* p_position_b = get_Positions(positions, oxygenator_entity);
-				c_dimension* p_dimension_b = get_Dimensions(dimensions, oxygenator_entity);
-				bool bounding_box_with_oxygenator = (p_position_b != NULL && p_dimension_b);
-				if(bounding_box_with_oxygenator) {
-					oxygenatorAndHealthOverlap = overlaps_pos_dim(p_position_a, p_dimension_a, p_position_b, p_dimension_b);
-					if(oxygenatorAndHealthOverlap) {
-						o2_x_health = true;	
-						*p_health = min(MAX_HEALTH, *p_health+delta);
-						break;
-					} else {
-						*p_health = max(0, *p_health-delta);
-					}
-				}
-			}
-		
+	spatial_hash_clear(oxygenator_grid);
+	Query oxygenator_query = QUERY(oxygenators, positions, dimensions);
+	while(query_next(&oxygenator_query)) {
+		c_position* p_position = oxygenator_query.components[1];
+		c_dimension* p_dimension = oxygenator_query.components[2];
+		spatial_hash_insert(oxygenator_grid, oxygenator_query.entity, p_position->x, p_position->y, p_dimension->width, p_dimension->height);
+	}
+	spatial_hash_build(oxygenator_grid);
+
+	OxygenationPass pass = {
+		.oxygenator_grid = oxygenator_grid,
+		.healths = healths,
+		.positions = positions,
+		.dimensions = dimensions,
+		.delta = delta,
+		.p_occupied = p_occupied,
+	};
+	Query health_query = QUERY(healths, positions, dimensions);
+	job_buffers_clear(p_occupied);
+	job_parallel_for(jobs, worker, query_row_count(&health_query), PARALLEL_CHUNK_ROWS, oxygenate_rows, &pass);
+	for (int i = 0; i < jobs->worker_count; i++) {
+		uint32_t* boxes = p_occupied->items[i];
+		for (uint32_t j = 0; j < p_occupied->counts[i]; j++) {
+			oxygenator_grid->marked[boxes[j]] = true;
 		}
+	}
+
+	for(uint32_t i = 0; i < oxygenator_grid->box_count; i++) {
+		Entity oxygenator_entity = oxygenator_grid->entities[i];
 		c_sound* pOxygenator_sound = get_Sounds(sounds, oxygenator_entity);
-		if(o2_x_health) {
+		if(oxygenator_grid->marked[i]) {
 			if(pOxygenator_sound == NULL) {
-				add_Sounds(sounds, oxygenator_entity, (c_sound){ fname: "o2-refill.wav", repeat: false });
-				if (!init_sound(get_Sounds(sounds, oxygenator_entity))) {
+				c_sound sound = { fname: "o2-refill.wav", repeat: false };
+				if (!init_sound(&sound)) {
 					SDL_Log("Failed to initialize sound: %s", SDL_GetError());
 				}
+				defer_add_Sounds(commands, writer, sounds, oxygenator_entity, sound);
 			}
 		}
 		else if (pOxygenator_sound != NULL) {
-			remove_Sounds(sounds, oxygenator_entity);
+			release_sound(pOxygenator_sound);
+			defer_remove_Sounds(commands, writer, sounds, oxygenator_entity);
 		}
 	}
 }
 
-void spawn_characters(uint32_t spawnCount, size_t *p_entityCount, Healths* healths, Containers* containers, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_FRect *p_rect_spawn_bounds) {
+Entity spawn_characters(uint32_t spawnCount, Entities* entities, Healths* healths, Containers* containers, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_FRect *p_rect_spawn_bounds) {
 	uint32_t character_width = 50;
 	uint32_t character_height = 50;
+	Entity entity = NULL_ENTITY;
 	for(int i = 0; i < spawnCount; i++) {
-		size_t entity = (*p_entityCount);
+		entity = create_entity(entities);
 
 		c_position position = (c_position) {
 			.x = rand() / (RAND_MAX / (p_rect_spawn_bounds->w - character_width + 1)) + p_rect_spawn_bounds->x,
@@ -254,219 +332,972 @@ void spawn_characters(uint32_t spawnCount, size_t *p_entityCount, Healths* healt
 		});
 		add_Healths(healths, entity, MAX_HEALTH);
 		add_Containers(containers, entity, (c_container) { .containables = {}, .count = 0 });
-		printf("<CHARACTER_SPAWNED> %zu", *p_entityCount);
-		(*p_entityCount)++;
+		printf("<CHARACTER_SPAWNED> %d", entity);
 	}
+	return entity;
 }
 
-void spawn_player(size_t *p_entityCount, bool player_controlled[], Healths* healths, Containers* containers, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_FRect *p_rect_spawn_bounds) {
-	player_controlled[*p_entityCount] = true;
-	spawn_characters(1, p_entityCount, healths, containers, positions, dimensions, colors, p_rect_spawn_bounds);
-	printf("<PLAYER SPAWNED>%s\n", player_controlled[*p_entityCount] ? "true" : "false");
+void spawn_player(Entities* entities, PlayerControlled* player_controlled, Healths* healths, Containers* containers, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_FRect *p_rect_spawn_bounds) {
+	Entity player = spawn_characters(1, entities, healths, containers, positions, dimensions, colors, p_rect_spawn_bounds);
+	add_PlayerControlled(player_controlled, player);
+	printf("<PLAYER SPAWNED>%s\n", has_PlayerControlled(player_controlled, player) ? "true" : "false");
 }
 
-void spawn_o2_tanks(uint32_t spawn_count, size_t* p_entity_count, Positions* positions, Dimensions* dimensions, Colors* colors, Containables* containables, Sprites* sprites, SDL_FRect *p_rect_spawn_bounds) {
+void spawn_o2_tanks(uint32_t spawn_count, Entities* entities, Positions* positions, Dimensions* dimensions, Colors* colors, Containables* containables, Sprites* sprites, SDL_FRect *p_rect_spawn_bounds) {
 	uint32_t width = 20;
 	uint32_t height = 40;
 	for(uint32_t i = 0; i < spawn_count; i++) {
-		Entity entity = *p_entity_count;
+		Entity entity = create_entity(entities);
 		add_Positions(positions, entity, (c_position) {
 			.x = rand() / (RAND_MAX / (p_rect_spawn_bounds->w - width + 1)) + p_rect_spawn_bounds->x,
 			.y = rand() / (RAND_MAX / (p_rect_spawn_bounds->h - height + 1)) + p_rect_spawn_bounds->y,
 		});
 		add_Dimensions(dimensions, entity, (c_dimension) { .width = width, height = height });
-		add_Containables(containables, entity, true);
+		add_Containables(containables, entity);
 		add_Sprites(sprites, entity, o2_tank_sprite);
-		printf("<O2_TANK_SPAWNED> %zu\n", *p_entity_count);
-		(*p_entity_count)++;
+		printf("<O2_TANK_SPAWNED> %d\n", entity);
 	}
 }
 
-void spawn_house(size_t *p_entityCount, Oxygenators* oxygenators, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_Rect *p_display_bounds) {
+void spawn_house(Entities* entities, Oxygenators* oxygenators, Positions* positions, Dimensions* dimensions, Colors* colors, SDL_Rect *p_display_bounds) {
 	const uint32_t HOUSE_WIDTH = 300;
 	const uint32_t HOUSE_HEIGHT = 300;
-	add_Oxygenators(oxygenators, *p_entityCount, true);
-	add_Positions(positions, *p_entityCount, (c_position) {
+	Entity house = create_entity(entities);
+	add_Oxygenators(oxygenators, house);
+	add_Positions(positions, house, (c_position) {
 		.x = (p_display_bounds->w / 2) - (HOUSE_WIDTH / 2),
 		.y = (p_display_bounds->h / 2) - (HOUSE_HEIGHT / 2),
 	});
-	add_Dimensions(dimensions, *p_entityCount, (c_dimension) {
+	add_Dimensions(dimensions, house, (c_dimension) {
 		.width = HOUSE_WIDTH,
 		.height = HOUSE_HEIGHT,
 	});
-	add_Colors(colors, *p_entityCount, (c_color) {
+	add_Colors(colors, house, (c_color) {
 		.red = 100,
 		.green = 100,
 		.blue = 100
 	});
-	printf("<HOUSE_SPAWNED> %zu", *p_entityCount);
-	(*p_entityCount)++;
+	printf("<HOUSE_SPAWNED> %d", house);
 }
 
-void init(SDL_Rect *p_display_bounds, size_t *p_entityCount, Oxygenators* oxygenators, Healths* healths, bool player_controlled[], Sounds* sounds, Positions* positions, Dimensions* dimensions, Colors* colors, Containables* containables, Containers* containers, Sprites* sprites) {
-	for(size_t i = 0; i < MAX_ENTITY_COUNT; i++) {
-		healths->entities[i] = -1;
-		healths->data[i] = -1;
-		healths->entity_index[i] = -1;
-		sounds->entities[i] = -1;
-		sounds->entity_index[i] = -1;
-	}
-	spawn_house(p_entityCount, oxygenators, positions, dimensions, colors, p_display_bounds);
+void init(SDL_Rect *p_display_bounds, Entities* entities, Oxygenators* oxygenators, Healths* healths, PlayerControlled* player_controlled, Sounds* sounds, Positions* positions, Dimensions* dimensions, Colors* colors, Containables* containables, Containers* containers, Sprites* sprites) {
+	spawn_house(entities, oxygenators, positions, dimensions, colors, p_display_bounds);
 	SDL_FRect character_spawn_bounds;
 	SDL_RectToFRect(p_display_bounds, &character_spawn_bounds);
-	spawn_characters(10, p_entityCount, healths, containers, positions, dimensions, colors, &character_spawn_bounds);
-	spawn_player(p_entityCount, player_controlled, healths, containers, positions, dimensions, colors, &character_spawn_bounds);
-	spawn_o2_tanks(15, p_entityCount, positions, dimensions, colors, containables, sprites, &character_spawn_bounds);
+	spawn_characters(10, entities, healths, containers, positions, dimensions, colors, &character_spawn_bounds);
+	spawn_player(entities, player_controlled, healths, containers, positions, dimensions, colors, &character_spawn_bounds);
+	spawn_o2_tanks(15, entities, positions, dimensions, colors, containables, sprites, &character_spawn_bounds);
 }
 
-void update_player(long *p_time_since_last_tick, size_t *p_entityCount, bool player_controlled[], Positions* positions, bool left, bool right, bool up, bool down) {
+// Remembers every position before a simulation step so rendering can
+// interpolate. Entities seeing their first step get their snapshot through
+// `commands`, since adding a component may move the pools being iterated.
+void sys_position_previous_position(CommandBuffer* commands, int writer, Positions* positions, PreviousPositions* previous_positions) {
+	Query q = QUERY(positions);
+	while(query_next(&q)) {
+		c_position* p_previous = get_PreviousPositions(previous_positions, q.entity);
+		if (p_previous != NULL) {
+			*p_previous = *(c_position*)q.components[0];
+		} else {
+			defer_add_PreviousPositions(commands, writer, previous_positions, q.entity, *(c_position*)q.components[0]);
+		}
+	}
+}
+
+void update_player(long *p_time_since_last_tick, PlayerControlled* player_controlled, Positions* positions, bool left, bool right, bool up, bool down) {
 	float pixels_per_foot = 50.0f;
 	float fps = 10.0f;
 	float fpns = fps / NANO_SECONDS_PER_SECOND;
 	float delta = ((*p_time_since_last_tick) * fpns) * pixels_per_foot;
 
-	for(size_t i = 0; i < *p_entityCount; i++) {
-		if(player_controlled[i] == true) {
-			c_position* p_position = get_Positions(positions, i);
-			assert(p_position != NULL);
+	Query q = QUERY(player_controlled, positions);
+	while(query_next(&q)) {
+		c_position* p_position = q.components[1];
 
-			if(left) {
-				p_position->x -= delta;
-			}
-			if(right) {
-				p_position->x += delta;
-			}
-			if(up) {
-				p_position->y -= delta;
-			}
-			if(down) {
-				p_position->y += delta;
+		if(left) {
+			p_position->x -= delta;
+		}
+		if(right) {
+			p_position->x += delta;
+		}
+		if(up) {
+			p_position->y -= delta;
+		}
+		if(down) {
+			p_position->y += delta;
+		}
+	}
+}
+
+// A containable overlapping a container, found by the parallel half of the
+// pickup system. `row` and `order` keep the serial visiting order.
+typedef struct PickupCandidate {
+	Entity row;
+	uint32_t order;
+	Entity container;
+	uint32_t box;
+} PickupCandidate;
+
+int pickup_candidate_compare(const void* a, const void* b) {
+	const PickupCandidate* candidate_a = a;
+	const PickupCandidate* candidate_b = b;
+	if (candidate_a->row != candidate_b->row) {
+		return candidate_a->row < candidate_b->row ? -1 : 1;
+	}
+	return (candidate_a->order > candidate_b->order) - (candidate_a->order < candidate_b->order);
+}
+
+typedef struct PickupPass {
+	SpatialHash* containable_grid;
+	Containers* containers;
+	Positions* positions;
+	Dimensions* dimensions;
+	JobBuffers* p_candidates;
+} PickupPass;
+
+void find_pickup_rows(int worker, int32_t begin, int32_t end, void* data) {
+	PickupPass* pass = data;
+	Query container_query = QUERY(pass->containers, pass->positions, pass->dimensions);
+	query_limit(&container_query, begin, end);
+	Entity row = begin;
+	while(query_next(&container_query)) {
+		c_container* p_container = container_query.components[0];
+		c_position* p_container_position = container_query.components[1];
+		c_dimension* p_container_dimension = container_query.components[2];
+		uint32_t order = 0;
+		// full containers cannot take anything
+		if (p_container->count < 10) {
+			SpatialQuery overlaps = spatial_hash_query(pass->containable_grid, p_container_position->x, p_container_position->y, p_container_dimension->width, p_container_dimension->height);
+			while(spatial_query_next(&overlaps)) {
+				PickupCandidate* candidate = job_buffers_push(pass->p_candidates, worker);
+				*candidate = (PickupCandidate) { .row = row, .order = order++, .container = container_query.entity, .box = overlaps.box };
 			}
 		}
+		row++;
 	}
 }
 
-void sys_containables_container_position_dimension_sound(Containables* containables, Containers* containers, Positions* positions, Dimensions* dimensions, Sounds* sounds) {
-	for(uint32_t i = 0; i < containers->count; i++) {
-		Entity container_entity = containers->entities[i];
-		c_container* p_container = &containers->data[i];
-		c_position* p_container_position = get_Positions(positions, container_entity);
-		c_dimension* p_container_dimension = get_Dimensions(dimensions, container_entity);
-
-		bool physical_container = 
-			p_container != NULL && 
-			p_container_position != NULL &&
-			p_container_dimension != NULL;
-		if (!physical_container)
-			continue;
+// Containers pick up the containables they overlap, in query order, while
+// they have space. Finding the overlaps runs in parallel chunks; the pickups
+// themselves are then resolved on this thread in the same order as a serial
+// pass would, so the first container to reach a containable still takes it.
+// Picked up containables lose their position and dimension through `commands`.
+void sys_containables_container_position_dimension_sound(JobSystem* jobs, int worker, CommandBuffer* commands, int writer, SpatialHash* containable_grid, JobBuffers* p_candidates, Containables* containables, Containers* containers, Positions* positions, Dimensions* dimensions, Sounds* sounds) {
+	spatial_hash_clear(containable_grid);
+	Query containable_query = QUERY(containables, positions, dimensions);
+	while(query_next(&containable_query)) {
+		c_position* p_position = containable_query.components[1];
+		c_dimension* p_dimension = containable_query.components[2];
+		spatial_hash_insert(containable_grid, containable_query.entity, p_position->x, p_position->y, p_dimension->width, p_dimension->height);
+	}
+	spatial_hash_build(containable_grid);
+
+	PickupPass pass = {
+		.containable_grid = containable_grid,
+		.containers = containers,
+		.positions = positions,
+		.dimensions = dimensions,
+		.p_candidates = p_candidates,
+	};
+	Query container_query = QUERY(containers, positions, dimensions);
+	job_buffers_clear(p_candidates);
+	job_parallel_for(jobs, worker, query_row_count(&container_query), PARALLEL_CHUNK_ROWS, find_pickup_rows, &pass);
+
+	// the candidates grow with the overlaps, without bound, so they are merged into growable memory
+	uint32_t candidate_count;
+	PickupCandidate* candidates = job_buffers_merge(p_candidates, &candidate_count);
+	if (candidate_count > 1) {
+		qsort(candidates, candidate_count, sizeof(PickupCandidate), pickup_candidate_compare);
+	}
 
-		for(uint32_t j = 0; j < containables->count; j++) {
-			Entity containable_entity = containables->entities[j];
-			c_containable* p_containable = get_Containables(containables, containable_entity);
-			c_position* p_containable_position = get_Positions(positions, containable_entity);
-			c_dimension* p_containable_dimension = get_Dimensions(dimensions, containable_entity);
-			bool physical_containable = 
-				p_containable != NULL && 
-				p_containable_position != NULL &&
-				p_containable_dimension != NULL;
-			if (!physical_containable)
-				continue;
-
-			if (overlaps_pos_dim(p_containable_position, p_containable_dimension, p_container_position, p_container_dimension)) {
-				bool container_has_space = p_container->count < 10;
-				if (container_has_space) {
-					p_container->containables[p_container->count] = containable_entity;
-					p_container->count++;
-					remove_Positions(positions, containable_entity);
-					remove_Dimensions(dimensions, containable_entity);
-					add_Sounds(sounds, container_entity, (c_sound){ fname: "pick-up.wav", repeat: false });
-					c_sound* p_sound = get_Sounds(sounds, container_entity);
-					if (!init_sound(p_sound)) {
-						SDL_Log("Failed to initialize sound: %s", SDL_GetError());
-					}
-				}
+	for (uint32_t i = 0; i < candidate_count;) {
+		Entity container_entity = candidates[i].container;
+		c_container* p_container = get_Containers(containers, container_entity);
+
+		// a containable is marked once picked up so no other container can take it this tick
+		bool picked_up = false;
+		for (; i < candidate_count && candidates[i].container == container_entity; i++) {
+			uint32_t box = candidates[i].box;
+			Entity containable_entity = containable_grid->entities[box];
+			bool container_has_space = p_container->count < 10;
+			if (container_has_space && !containable_grid->marked[box]) {
+				containable_grid->marked[box] = true;
+				p_container->containables[p_container->count] = containable_entity;
+				p_container->count++;
+				defer_remove_Positions(commands, writer, positions, containable_entity);
+				defer_remove_Dimensions(commands, writer, dimensions, containable_entity);
+				picked_up = true;
+			}
+		}
+		if (picked_up) {
+			// acquired before the previous pickup's sound is released, so the cache keeps the asset decoded
+			c_sound sound = { fname: "pick-up.wav", repeat: false };
+			if (!init_sound(&sound)) {
+				SDL_Log("Failed to initialize sound: %s", SDL_GetError());
 			}
+			c_sound* p_previous_sound = get_Sounds(sounds, container_entity);
+			if (p_previous_sound != NULL) {
+				release_sound(p_previous_sound);
+			}
+			defer_add_Sounds(commands, writer, sounds, container_entity, sound);
 		}
 	}
 }
 
-void sys_health_dimension_position(Healths* healths, Positions* positions, Dimensions* dimensions, SDL_Renderer *p_sdl_renderer) {
-	SDL_FRect health_background = {
-		.x = 0,
-		.y = 0,
-		.w = 80,
-		.h = 10
+// =======================================================================================
+// Render snapshots: the simulation thread copies what rendering needs out of
+// the pools after every batch of steps, and the main thread draws from the
+// latest published snapshot without touching the pools. Every quad carries
+// its position before and after the last step so rendering can interpolate.
+typedef struct RenderQuad {
+	Entity entity;
+	c_position previous;
+	c_position position;
+	c_dimension dimension;
+} RenderQuad;
+
+typedef struct RenderColor {
+	RenderQuad quad;
+	c_color color;
+} RenderColor;
+
+typedef struct RenderSprite {
+	RenderQuad quad;
+	c_sprite sprite;
+} RenderSprite;
+
+typedef struct RenderHealth {
+	RenderQuad quad;
+	c_health health;
+} RenderHealth;
+
+typedef struct RenderSnapshot {
+	// simulation time left over after the last step, and when it was measured
+	long accumulator;
+	long step;
+	Uint64 published_ns;
+	Entity entity_count;
+	RenderColor* colors;
+	uint32_t color_count;
+	uint32_t color_capacity;
+	RenderSprite* sprites;
+	uint32_t sprite_count;
+	uint32_t sprite_capacity;
+	RenderHealth* healths;
+	uint32_t health_count;
+	uint32_t health_capacity;
+} RenderSnapshot;
+
+// grows a snapshot array so it can take one more item; the arrays are reused between snapshots.
+void* snapshot_reserve(void* items, uint32_t* p_capacity, uint32_t count, size_t size) {
+	if (count < *p_capacity) {
+		return items;
+	}
+	*p_capacity = *p_capacity ? *p_capacity * 2 : 64;
+	items = realloc(items, *p_capacity * size);
+	assert(items != NULL);
+	return items;
+}
+
+RenderQuad render_quad(PreviousPositions* previous_positions, Entity entity, c_position* p_position, c_dimension* p_dimension) {
+	c_position* p_previous = get_PreviousPositions(previous_positions, entity);
+	return (RenderQuad) {
+		.entity = entity,
+		.previous = p_previous != NULL ? *p_previous : *p_position,
+		.position = *p_position,
+		.dimension = *p_dimension,
 	};
-	SDL_FRect health_foreground = {
-		.x = 0,
-		.y = 0,
-		.w = 80,
-		.h = 20
+}
+
+// position `alpha` of the way from the quad's previous step to its current one.
+c_position render_position(const RenderQuad* quad, float alpha) {
+	return (c_position) {
+		.x = quad->previous.x + (quad->position.x - quad->previous.x) * alpha,
+		.y = quad->previous.y + (quad->position.y - quad->previous.y) * alpha,
 	};
+}
 
-	for(size_t i = 0; i < healths->count; i++) {
-		Entity e = healths->entities[i];
-		c_health* p_health = &healths->data[i];
-		c_position* p_position = get_Positions(positions, e);
-		c_dimension* p_dimension = get_Dimensions(dimensions, e);
-		bool not_renderable = p_position == NULL || p_dimension == NULL;
-		if (not_renderable) {
-			continue;
-		}
+void sys_position_dimension_color(Positions* positions, PreviousPositions* previous_positions, Dimensions* dimensions, Colors* colors, RenderSnapshot* snapshot) {
+	snapshot->color_count = 0;
+	Query q = QUERY(colors, positions, dimensions);
+	while(query_next(&q)) {
+		snapshot->colors = snapshot_reserve(snapshot->colors, &snapshot->color_capacity, snapshot->color_count, sizeof(RenderColor));
+		snapshot->colors[snapshot->color_count++] = (RenderColor) {
+			.quad = render_quad(previous_positions, q.entity, q.components[1], q.components[2]),
+			.color = *(c_color*)q.components[0],
+		};
+	}
+}
+
+void sys_position_dimension_sprite(Positions* positions, PreviousPositions* previous_positions, Dimensions* dimensions, Sprites* sprites, RenderSnapshot* snapshot) {
+	snapshot->sprite_count = 0;
+	Query q = QUERY(sprites, positions, dimensions);
+	while(query_next(&q)) {
+		snapshot->sprites = snapshot_reserve(snapshot->sprites, &snapshot->sprite_capacity, snapshot->sprite_count, sizeof(RenderSprite));
+		snapshot->sprites[snapshot->sprite_count++] = (RenderSprite) {
+			.quad = render_quad(previous_positions, q.entity, q.components[1], q.components[2]),
+			.sprite = *(c_sprite*)q.components[0],
+		};
+	}
+}
 
-		float health_x = p_position->x - (health_background.w / 2) + (p_dimension->width / 2);
-		float health_y = p_position->y - 30;
-
-		health_background.x = health_x;
-		health_background.y = health_y;
-		health_foreground.x = health_x;
-		health_foreground.y = health_y - (health_background.h / 2);
-		health_foreground.w = ((float)*p_health / MAX_HEALTH ) * health_background.w;
-		// Render Red Bar Background
-		SDL_SetRenderDrawColor(p_sdl_renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
-		SDL_RenderFillRect(p_sdl_renderer, &health_background);
-		// Render Green Bar Background
-		SDL_SetRenderDrawColor(p_sdl_renderer, 0, 255, 0, 100);
-		SDL_RenderFillRect(p_sdl_renderer, &health_foreground);
+void sys_health_dimension_position(Healths* healths, Positions* positions, PreviousPositions* previous_positions, Dimensions* dimensions, RenderSnapshot* snapshot) {
+	snapshot->health_count = 0;
+	Query q = QUERY(healths, positions, dimensions);
+	while(query_next(&q)) {
+		snapshot->healths = snapshot_reserve(snapshot->healths, &snapshot->health_capacity, snapshot->health_count, sizeof(RenderHealth));
+		snapshot->healths[snapshot->health_count++] = (RenderHealth) {
+			.quad = render_quad(previous_positions, q.entity, q.components[1], q.components[2]),
+			.health = *(c_health*)q.components[0],
+		};
 	}
 }
 
-void sys_position_dimension_sprite(Positions* positions, Dimensions* dimensions, Sprites* sprites, SDL_Renderer *p_sdl_renderer) {
-	for(size_t i = 0; i < sprites->count; i++) {
-		Entity e = sprites->entities[i];
-		c_position* p_position = get_Positions(positions, e);
-		c_dimension* p_dimension = get_Dimensions(dimensions, e);
-		c_sprite* p_sprite = get_Sprites(sprites, e);
-		if (p_position == NULL || p_sprite == NULL || p_dimension == NULL)
+// fraction of a step the render thread is past the snapshot, capped at the current step.
+float snapshot_alpha(const RenderSnapshot* snapshot) {
+	if (snapshot->step == 0) {
+		return 1.0f;
+	}
+	float alpha = (float)(snapshot->accumulator + (long)(SDL_GetTicksNS() - snapshot->published_ns)) / snapshot->step;
+	return alpha < 1.0f ? alpha : 1.0f;
+}
+
+// Health bars are drawn as a background and a foreground quad per entity in
+// one geometry call. Each bar slot remembers what it was built from, and while
+// the snapshot lists the same entities in the same order, bars whose entity,
+// health and position are unchanged keep last frame's vertices.
+typedef struct HealthBarKey {
+	Entity entity;
+	c_health health;
+	float x;
+	float y;
+} HealthBarKey;
+
+typedef struct HealthBarCache {
+	QuadBatch batch;
+	HealthBarKey* keys;
+	int key_count;
+	int key_capacity;
+} HealthBarCache;
+
+void render_health_bars(const RenderSnapshot* snapshot, float alpha, HealthBarCache* cache, SDL_Renderer *p_sdl_renderer) {
+	const float bar_width = 80;
+	const float bar_height = 10;
+	const SDL_FColor background_color = { 1.0f, 0.0f, 0.0f, 1.0f };
+	const SDL_FColor foreground_color = { 0.0f, 1.0f, 0.0f, 100 / 255.0f };
+
+	int bar = 0;
+	for (uint32_t i = 0; i < snapshot->health_count; i++) {
+		const RenderHealth* p_health = &snapshot->healths[i];
+		c_position position = render_position(&p_health->quad, alpha);
+
+		float health_x = position.x - (bar_width / 2) + (p_health->quad.dimension.width / 2);
+		float health_y = position.y - 30;
+		HealthBarKey key = { .entity = p_health->quad.entity, .health = p_health->health, .x = health_x, .y = health_y };
+
+		if (bar == cache->key_capacity) {
+			cache->key_capacity = cache->key_capacity ? cache->key_capacity * 2 : 64;
+			cache->keys = realloc(cache->keys, cache->key_capacity * sizeof(HealthBarKey));
+			assert(cache->keys != NULL);
+		}
+		HealthBarKey* p_cached = &cache->keys[bar++];
+		if (bar <= cache->key_count && memcmp(p_cached, &key, sizeof(key)) == 0) {
+			cache->batch.quad_count += 2;
 			continue;
+		}
+		*p_cached = key;
+
+		// Red Bar Background
+		quad_batch_push(&cache->batch, &(SDL_FRect) {
+			.x = health_x,
+			.y = health_y,
+			.w = bar_width,
+			.h = bar_height
+		}, background_color, NULL);
+		// Green Bar Foreground
+		quad_batch_push(&cache->batch, &(SDL_FRect) {
+			.x = health_x,
+			.y = health_y - (bar_height / 2),
+			.w = ((float)p_health->health / MAX_HEALTH ) * bar_width,
+			.h = bar_height * 2
+		}, foreground_color, NULL);
+	}
+	cache->key_count = bar;
+	quad_batch_flush(&cache->batch, p_sdl_renderer, NULL);
+}
+
+// Sprites are queued per atlas page and drawn with one geometry call per page.
+void render_sprites(const RenderSnapshot* snapshot, float alpha, SpriteAtlas* atlas, SDL_Renderer *p_sdl_renderer) {
+	for (uint32_t i = 0; i < snapshot->sprite_count; i++) {
+		const RenderSprite* p_sprite = &snapshot->sprites[i];
+		c_position position = render_position(&p_sprite->quad, alpha);
 
 		SDL_FRect dst;
-		dst.w = p_dimension->width;
-		dst.h = p_dimension->height;
-		dst.x = p_position->x;
-		dst.y = p_position->y;
+		dst.w = p_sprite->quad.dimension.width;
+		dst.h = p_sprite->quad.dimension.height;
+		dst.x = position.x;
+		dst.y = position.y;
 
-		SDL_RenderTexture(p_sdl_renderer, *p_sprite, NULL, &dst);
+		sprite_atlas_push(atlas, p_sprite->sprite, &dst);
 	}
+	sprite_atlas_flush(atlas, p_sdl_renderer);
 }
 
-void sys_position_dimension_color(Positions* positions, Dimensions* dimensions, Colors* colors, SDL_Renderer *p_sdl_renderer) {
-	for(size_t i = 0; i < colors->count; i++) {
-		Entity e = colors->entities[i];
-		c_position* p_position = get_Positions(positions, e);
-		c_dimension* p_dimension = get_Dimensions(dimensions, e);
-		c_color* p_color = get_Colors(colors, e);
-		if (p_position == NULL || p_color == NULL || p_dimension == NULL)
-			continue;
+// All coloured rects of the frame go out in one geometry call.
+void render_colors(const RenderSnapshot* snapshot, float alpha, QuadBatch* batch, SDL_Renderer *p_sdl_renderer) {
+	for (uint32_t i = 0; i < snapshot->color_count; i++) {
+		const RenderColor* p_color = &snapshot->colors[i];
+		c_position position = render_position(&p_color->quad, alpha);
+
+		quad_batch_push(batch, &(SDL_FRect) {
+			.x = position.x,
+			.y = position.y,
+			.w = p_color->quad.dimension.width,
+			.h = p_color->quad.dimension.height
+		}, (SDL_FColor) {
+			.r = p_color->color.red / 255.0f,
+			.g = p_color->color.green / 255.0f,
+			.b = p_color->color.blue / 255.0f,
+			.a = 1.0f
+		}, NULL);
+	}
+	quad_batch_flush(batch, p_sdl_renderer, NULL);
+}
 
-		SDL_SetRenderDrawColor(p_sdl_renderer, p_color->red, p_color->green, p_color->blue, SDL_ALPHA_OPAQUE);
-		SDL_RenderFillRect(p_sdl_renderer, &(SDL_FRect) {
-			.x = p_position->x,
-			.y = p_position->y,
-			.w = p_dimension->width,
-			.h = p_dimension->height
-		});
+#define PROFILER_GRAPH_HEIGHT 100.0f
+#define PROFILER_GRAPH_MS 50.0f
+#define PROFILER_BAR_WIDTH 2.0f
+
+// Profiler overlay at (x, y): frame time min/avg/p99, a graph of the recent
+// frame times against a 60 Hz budget, and the average and worst time of every
+// timed scope. The text goes out with the caller's next text_flush.
+void render_profiler(TextRenderer* text, QuadBatch* batch, Arena* arena, float x, float y, SDL_Renderer *p_sdl_renderer) {
+	const SDL_FColor text_color = { 1.0f, 1.0f, 1.0f, 1.0f };
+	const SDL_FColor within_budget = { 0.0f, 0.8f, 0.0f, 1.0f };
+	const SDL_FColor over_budget = { 0.9f, 0.1f, 0.1f, 1.0f };
+	const float budget_ms = 1000.0f / 60.0f;
+	const float pixels_per_ms = PROFILER_GRAPH_HEIGHT / PROFILER_GRAPH_MS;
+
+	float min_ms, average_ms, p99_ms;
+	if (profile_frame_times(&min_ms, &average_ms, &p99_ms)) {
+		text_draw(text, arena_printf(arena, "frame ms: min %.2f avg %.2f p99 %.2f", min_ms, average_ms, p99_ms), x, y, text_color);
+	}
+	y += text->line_height;
+
+	// newest frame on the right
+	for (int age = 0; age < PROFILE_FRAME_HISTORY; age++) {
+		float ms = profile_frame_ms(age);
+		float height = (ms < PROFILER_GRAPH_MS ? ms : PROFILER_GRAPH_MS) * pixels_per_ms;
+		quad_batch_push(batch, &(SDL_FRect) {
+			.x = x + (PROFILE_FRAME_HISTORY - 1 - age) * PROFILER_BAR_WIDTH,
+			.y = y + PROFILER_GRAPH_HEIGHT - height,
+			.w = PROFILER_BAR_WIDTH,
+			.h = height
+		}, ms > budget_ms ? over_budget : within_budget, NULL);
+	}
+	quad_batch_push(batch, &(SDL_FRect) {
+		.x = x,
+		.y = y + PROFILER_GRAPH_HEIGHT - budget_ms * pixels_per_ms,
+		.w = PROFILE_FRAME_HISTORY * PROFILER_BAR_WIDTH,
+		.h = 1
+	}, text_color, NULL);
+	quad_batch_flush(batch, p_sdl_renderer, NULL);
+	y += PROFILER_GRAPH_HEIGHT + text->line_height / 2;
+
+	for (int i = 0; i < profiler.stat_count; i++) {
+		const ProfileStat* stat = &profiler.stats[i];
+		text_draw(text, arena_printf(arena, "%s: %.3f ms (max %.3f)", stat->name, stat->average_ms, stat->max_ms), x, y, text_color);
+		y += text->line_height;
+	}
+}
+
+// =======================================================================================
+// The world: every pool plus the state shared between the simulation thread,
+// which owns the pools once it is started, and the main thread, which polls
+// events and renders snapshots.
+enum Input {
+	INPUT_LEFT = 1,
+	INPUT_RIGHT = 2,
+	INPUT_UP = 4,
+	INPUT_DOWN = 8,
+};
+
+// One bit per pool, for declaring what a scheduled system reads and writes.
+enum Pool {
+	POOL_COLORS = 1 << 0,
+	POOL_CONTAINABLES = 1 << 1,
+	POOL_CONTAINERS = 1 << 2,
+	POOL_DIMENSIONS = 1 << 3,
+	POOL_HEALTHS = 1 << 4,
+	POOL_OXYGENATORS = 1 << 5,
+	POOL_PLAYER_CONTROLLED = 1 << 6,
+	POOL_POSITIONS = 1 << 7,
+	POOL_PREVIOUS_POSITIONS = 1 << 8,
+	POOL_SOUNDS = 1 << 9,
+	POOL_SPRITES = 1 << 10,
+};
+
+// Command writers of the step systems, in registration order. Each system
+// records from one thread at a time into its own writer, so commands for the
+// same entity and pool apply in this order whichever workers ran them.
+enum StepWriter {
+	WRITER_PREVIOUS_POSITIONS,
+	WRITER_OXYGENATORS,
+	WRITER_PICKUPS,
+	WRITER_COUNT,
+};
+_Static_assert(WRITER_COUNT <= COMMAND_MAX_WRITERS, "a step system without a command writer");
+
+typedef struct World {
+	Entities entities;
+	BackgroundMusic background_music;
+	Colors colors;
+	Containables containables;
+	Containers containers;
+	Dimensions dimensions;
+	Healths healths;
+	Oxygenators oxygenators;
+	PlayerControlled player_controlled;
+	Positions positions;
+	PreviousPositions previous_positions;
+	Sounds sounds;
+	Sprites sprites;
+	// broadphase grids, rebuilt every tick by the systems that own them
+	SpatialHash oxygenator_grid;
+	SpatialHash containable_grid;
+	// per worker results of the parallel passes inside systems
+	JobBuffers occupied_oxygenators;
+	JobBuffers pickup_candidates;
+	// structural changes recorded by the step systems, one writer per system (enum StepWriter)
+	CommandBuffer commands;
+	// written by the main thread
+	SDL_AtomicInt running;
+	SDL_AtomicInt game_state;
+	// enum Input bits of the held direction keys
+	SDL_AtomicInt input;
+	// written by the simulation thread
+	RenderSnapshot snapshots[3];
+	TripleBuffer snapshot_buffer;
+	// systems of one simulation step, and of publishing a snapshot
+	JobSystem* jobs;
+	JobGraph step_graph;
+	JobGraph publish_graph;
+	// arguments of the current step and snapshot
+	long step;
+	int step_input;
+	RenderSnapshot* snapshot;
+	// recording the input of every step, or supplying it, unless NULL
+	Replay* replay;
+	// set by the main thread to have the simulation thread save to `save_path`
+	SDL_AtomicInt save_requested;
+	const char* save_path;
+	// the snapshot the pools were loaded from, kept until world_free
+	SnapshotMapping mapping;
+} World;
+
+// adapters from the job graph to the systems' own signatures
+void run_position_previous_position(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_position_previous_position(&world->commands, WRITER_PREVIOUS_POSITIONS, &world->positions, &world->previous_positions);
+}
+
+void run_update_player(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	int input = world->step_input;
+	update_player(&world->step, &world->player_controlled, &world->positions, input & INPUT_LEFT, input & INPUT_RIGHT, input & INPUT_UP, input & INPUT_DOWN);
+}
+
+void run_health_oxygenator_position_dimension_sound(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_health_oxygenator_position_dimension_sound(jobs, worker, &world->commands, WRITER_OXYGENATORS, &world->step, &world->oxygenator_grid, &world->occupied_oxygenators, &world->healths, &world->oxygenators, &world->positions, &world->dimensions, &world->sounds);
+}
+
+void run_containables_container_position_dimension_sound(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_containables_container_position_dimension_sound(jobs, worker, &world->commands, WRITER_PICKUPS, &world->containable_grid, &world->pickup_candidates, &world->containables, &world->containers, &world->positions, &world->dimensions, &world->sounds);
+}
+
+void run_sound(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_sound(&world->sounds);
+}
+
+void run_position_dimension_color(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_position_dimension_color(&world->positions, &world->previous_positions, &world->dimensions, &world->colors, world->snapshot);
+}
+
+void run_position_dimension_sprite(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_position_dimension_sprite(&world->positions, &world->previous_positions, &world->dimensions, &world->sprites, world->snapshot);
+}
+
+void run_health_dimension_position(JobSystem* jobs, int worker, void* data) {
+	World* world = data;
+	sys_health_dimension_position(&world->healths, &world->positions, &world->previous_positions, &world->dimensions, world->snapshot);
+}
+
+// Registers every system with the pools it reads and writes. Registration
+// order is the order conflicting systems run in. The sound cache and mixer
+// are only used by systems writing POOL_SOUNDS, and every snapshot system
+// fills its own snapshot arrays. Step systems only add and remove components
+// through the world's command buffer, which is applied after every step, so
+// no system sees a pool change shape under it; a pool changed that way still
+// counts as written.
+void world_schedule(World* world, JobSystem* jobs) {
+	world->jobs = jobs;
+	job_graph_add(&world->step_graph, "previous positions", run_position_previous_position, world,
+		POOL_POSITIONS, POOL_PREVIOUS_POSITIONS);
+	job_graph_add(&world->step_graph, "player", run_update_player, world,
+		POOL_PLAYER_CONTROLLED, POOL_POSITIONS);
+	job_graph_add(&world->step_graph, "oxygenators", run_health_oxygenator_position_dimension_sound, world,
+		POOL_OXYGENATORS | POOL_POSITIONS | POOL_DIMENSIONS, POOL_HEALTHS | POOL_SOUNDS);
+	job_graph_add(&world->step_graph, "pickups", run_containables_container_position_dimension_sound, world,
+		POOL_CONTAINABLES, POOL_CONTAINERS | POOL_POSITIONS | POOL_DIMENSIONS | POOL_SOUNDS);
+	job_graph_build(&world->step_graph);
+
+	job_graph_add(&world->publish_graph, "sound", run_sound, world,
+		0, POOL_SOUNDS);
+	job_graph_add(&world->publish_graph, "color snapshot", run_position_dimension_color, world,
+		POOL_POSITIONS | POOL_PREVIOUS_POSITIONS | POOL_DIMENSIONS | POOL_COLORS, 0);
+	job_graph_add(&world->publish_graph, "sprite snapshot", run_position_dimension_sprite, world,
+		POOL_POSITIONS | POOL_PREVIOUS_POSITIONS | POOL_DIMENSIONS | POOL_SPRITES, 0);
+	job_graph_add(&world->publish_graph, "health snapshot", run_health_dimension_position, world,
+		POOL_HEALTHS | POOL_POSITIONS | POOL_PREVIOUS_POSITIONS | POOL_DIMENSIONS, 0);
+	job_graph_build(&world->publish_graph);
+}
+
+// plays sounds and fills `snapshot`, in parallel.
+void world_publish(World* world, RenderSnapshot* snapshot) {
+	PROFILE_SCOPE("publish");
+	snapshot->entity_count = world->entities.count;
+	world->snapshot = snapshot;
+	job_graph_run(world->jobs, &world->publish_graph);
+	snapshot->published_ns = SDL_GetTicksNS();
+}
+
+// Sets up the parts of a world that do not depend on its population.
+void world_init(World* world, JobSystem* jobs) {
+	world->oxygenator_grid.cell_size = 128;
+	world->containable_grid.cell_size = 64;
+	world->occupied_oxygenators.stride = sizeof(uint32_t);
+	world->pickup_candidates.stride = sizeof(PickupCandidate);
+	world_schedule(world, jobs);
+}
+
+// frees the population and everything world_init set up; the world can be initialised again.
+void world_free(World* world) {
+	Query sound_query = QUERY(&world->sounds);
+	while(query_next(&sound_query)) {
+		release_sound(sound_query.components[0]);
+	}
+	free_Colors(&world->colors);
+	free_BackgroundMusic(&world->background_music);
+	free_Containables(&world->containables);
+	free_Containers(&world->containers);
+	free_Dimensions(&world->dimensions);
+	free_Healths(&world->healths);
+	free_Oxygenators(&world->oxygenators);
+	free_PlayerControlled(&world->player_controlled);
+	free_Positions(&world->positions);
+	free_PreviousPositions(&world->previous_positions);
+	free_Sounds(&world->sounds);
+	free_Sprites(&world->sprites);
+	free_entities(&world->entities);
+#if defined(ECS_BACKEND_ARCHETYPE)
+	archetype_world_free();
+#endif
+	snapshot_unmap(&world->mapping);
+	spatial_hash_free(&world->oxygenator_grid);
+	spatial_hash_free(&world->containable_grid);
+	job_buffers_free(&world->occupied_oxygenators);
+	job_buffers_free(&world->pickup_candidates);
+	command_buffer_free(&world->commands);
+	for (int i = 0; i < 3; i++) {
+		free(world->snapshots[i].colors);
+		free(world->snapshots[i].sprites);
+		free(world->snapshots[i].healths);
 	}
+	memset(world, 0, sizeof(*world));
+}
+
+#if !defined(ECS_BACKEND_ARCHETYPE)
+#define WORLD_SNAPSHOT_POOLS 11
+
+// The pools a snapshot holds. Sounds hold audio handles, so they are left out
+// and come back as the systems play them again; the background music entity
+// is kept tagged so main can start the music on it again.
+void world_snapshot_pools(World* world, SnapshotEntry pools[WORLD_SNAPSHOT_POOLS]) {
+	SnapshotEntry entries[WORLD_SNAPSHOT_POOLS] = {
+		{ "background music", 0, &world->background_music.set },
+		{ "colors", sizeof(c_color), &world->colors.set },
+		{ "containables", 0, &world->containables.set },
+		{ "containers", sizeof(c_container), &world->containers.set },
+		{ "dimensions", sizeof(c_dimension), &world->dimensions.set },
+		{ "healths", sizeof(c_health), &world->healths.set },
+		{ "oxygenators", 0, &world->oxygenators.set },
+		{ "player controlled", 0, &world->player_controlled.set },
+		{ "positions", sizeof(c_position), &world->positions.set },
+		{ "previous positions", sizeof(c_position), &world->previous_positions.set },
+		{ "sprites", sizeof(c_sprite), &world->sprites.set },
+	};
+	memcpy(pools, entries, sizeof(entries));
+}
+#endif
+
+// writes every pool but the sounds to `path`. Only the simulation thread may call this once it runs.
+bool world_save(World* world, const char* path) {
+#if defined(ECS_BACKEND_ARCHETYPE)
+	SDL_Log("Snapshots need the sparse set backend");
+	return false;
+#else
+	SnapshotEntry pools[WORLD_SNAPSHOT_POOLS];
+	world_snapshot_pools(world, pools);
+	Uint64 start = SDL_GetTicksNS();
+	if (!snapshot_save(path, &world->entities, WORLD_SNAPSHOT_POOLS, pools)) {
+		return false;
+	}
+	printf("<SNAPSHOT> saved %s: %d entities in %.3f ms\n", path, world->entities.count, (SDL_GetTicksNS() - start) / 1000000.0);
+	return true;
+#endif
+}
+
+// populates an initialised, empty world from the snapshot at `path`, in place of init().
+bool world_load(World* world, const char* path) {
+#if defined(ECS_BACKEND_ARCHETYPE)
+	SDL_Log("Snapshots need the sparse set backend");
+	return false;
+#else
+	SnapshotEntry pools[WORLD_SNAPSHOT_POOLS];
+	world_snapshot_pools(world, pools);
+	Uint64 start = SDL_GetTicksNS();
+	if (!snapshot_load(&world->mapping, path, &world->entities, WORLD_SNAPSHOT_POOLS, pools)) {
+		return false;
+	}
+	printf("<SNAPSHOT> loaded %s: %d entities in %.3f ms\n", path, world->entities.count, (SDL_GetTicksNS() - start) / 1000000.0);
+	return true;
+#endif
+}
+
+// advances the world by one fixed step of `world->step` nanoseconds with `world->step_input` held.
+void world_step(World* world) {
+	PROFILE_SCOPE("step");
+	job_graph_run(world->jobs, &world->step_graph);
+	ProfileScope commands_scope = profile_begin("commands");
+	command_buffer_apply(&world->commands, &world->entities);
+	profile_end(&commands_scope);
+}
+
+// picks the input held during the next step: `live_input`, recorded if a
+// recording is running, or the replay's. Returns false once a replay has run out.
+bool world_step_input(World* world, int live_input) {
+	Replay* replay = world->replay;
+	if (replay == NULL || replay->recording) {
+		world->step_input = live_input;
+		if (replay != NULL) {
+			replay_record_tick(replay, live_input);
+		}
+		return true;
+	}
+	return replay_next_tick(replay, &world->step_input);
+}
+
+// Sums a hash of every entity's position and health, in no particular order,
+// so two runs of the same replay can be checked for having simulated the same.
+uint64_t world_checksum(World* world) {
+	uint64_t checksum = 0;
+	Query position_query = QUERY(&world->positions);
+	while (query_next(&position_query)) {
+		struct {
+			Entity entity;
+			c_position position;
+			c_health health;
+		} state = { .entity = position_query.entity, .position = *(c_position*)position_query.components[0] };
+		c_health* p_health = get_Healths(&world->healths, position_query.entity);
+		state.health = p_health != NULL ? *p_health : -1;
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		const unsigned char* bytes = (const unsigned char*)&state;
+		for (size_t i = 0; i < sizeof(state); i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		checksum += hash;
+	}
+	return checksum;
+}
+
+// Opens the session at `replay_path` to play back, taking over its seed and
+// spawn bounds, or starts recording to `record_path` with a fresh seed and
+// `p_bounds`. Leaves `replay` closed when neither is given.
+bool session_open(Replay* replay, const char* record_path, const char* replay_path, SDL_Rect* p_bounds) {
+	if (replay_path != NULL) {
+		if (!replay_open(replay, replay_path)) {
+			return false;
+		}
+		if (replay->header.step_ns != NANO_SECONDS_PER_SECOND / SIMULATION_HZ) {
+			SDL_Log("%s was recorded with %llu ns steps, this build steps %d ns", replay_path,
+				(unsigned long long)replay->header.step_ns, NANO_SECONDS_PER_SECOND / SIMULATION_HZ);
+			replay_close(replay);
+			return false;
+		}
+		srand(replay->header.seed);
+		*p_bounds = (SDL_Rect) { .x = replay->header.x, .y = replay->header.y, .w = replay->header.w, .h = replay->header.h };
+		printf("<REPLAY> %s: %u ticks, seed %u\n", replay_path, replay->header.tick_count, replay->header.seed);
+	} else if (record_path != NULL) {
+		uint32_t seed = (uint32_t)time(NULL);
+		srand(seed);
+		ReplayHeader header = {
+			.step_ns = NANO_SECONDS_PER_SECOND / SIMULATION_HZ,
+			.seed = seed,
+			.x = p_bounds->x,
+			.y = p_bounds->y,
+			.w = p_bounds->w,
+			.h = p_bounds->h,
+		};
+		if (!replay_record(replay, record_path, header)) {
+			return false;
+		}
+		printf("<RECORDING> %s, seed %u\n", record_path, seed);
+	}
+	return true;
+}
+
+// Simulation thread: steps the world at SIMULATION_HZ while the game is
+// running and publishes a render snapshot after every batch of steps.
+int SDLCALL simulate(void* data) {
+	World* world = data;
+	profile_thread("simulation");
+	long simulation_step = NANO_SECONDS_PER_SECOND / SIMULATION_HZ;
+	long simulation_accumulator = 0;
+	Uint64 last = SDL_GetTicksNS();
+	bool replay_finished = false;
+	while (SDL_GetAtomicInt(&world->running)) {
+		Uint64 now = SDL_GetTicksNS();
+		long time_since_last_tick = (long)(now - last);
+		last = now;
+
+		if (SDL_GetAtomicInt(&world->game_state) == RUNNING && !replay_finished) {
+			simulation_accumulator += time_since_last_tick;
+			if (simulation_accumulator > MAX_SIMULATION_STEPS_PER_FRAME * simulation_step) {
+				simulation_accumulator = MAX_SIMULATION_STEPS_PER_FRAME * simulation_step;
+			}
+			world->step = simulation_step;
+			int input = SDL_GetAtomicInt(&world->input);
+			while (simulation_accumulator >= simulation_step) {
+				if (!world_step_input(world, input)) {
+					// the main thread quits on this, writing any trace it was asked for
+					printf("<REPLAY> finished\n");
+					replay_finished = true;
+					SDL_PushEvent(&(SDL_Event) { .type = SDL_EVENT_QUIT });
+					break;
+				}
+				world_step(world);
+				simulation_accumulator -= simulation_step;
+			}
+		} else {
+			simulation_accumulator = 0;
+		}
+		// between steps, so the pools are consistent
+		if (SDL_SetAtomicInt(&world->save_requested, 0)) {
+			world_save(world, world->save_path);
+		}
+
+		RenderSnapshot* snapshot = &world->snapshots[world->snapshot_buffer.back];
+		snapshot->accumulator = simulation_accumulator;
+		snapshot->step = simulation_step;
+		world_publish(world, snapshot);
+		triple_buffer_publish(&world->snapshot_buffer);
+
+		long idle = simulation_step - simulation_accumulator;
+		if (idle > 0) {
+			SDL_DelayNS(idle);
+		}
+	}
+	return 0;
+}
+
+int compare_ns(const void* a, const void* b) {
+	Uint64 ns_a = *(const Uint64*)a;
+	Uint64 ns_b = *(const Uint64*)b;
+	return (ns_a > ns_b) - (ns_a < ns_b);
+}
+
+// Runs `tick_count` simulation steps as fast as they go, on a synthetic clock
+// that advances exactly one step per tick, without a window, renderer, fonts
+// or audio. Reports the throughput and the distribution of tick times, and
+// writes the profiler's trace of the last ticks to `trace_path` unless NULL.
+// A replay runs for as many ticks as it holds, with its input. The world
+// starts from the snapshot at `load_path` and is saved to `save_path` after
+// the run, when they are given.
+int run_headless(long tick_count, int worker_count, const char* trace_path, const char* record_path, const char* replay_path, const char* load_path, const char* save_path) {
+	if (!SDL_Init(0)) {
+		SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
+		return SDL_APP_FAILURE;
+	}
+	profile_thread("simulation");
+	static JobSystem jobs;
+	if (!job_system_init(&jobs, worker_count - 1)) {
+		return SDL_APP_FAILURE;
+	}
+	static World world;
+	world_init(&world, &jobs);
+	// the window would have covered a 1080p display
+	SDL_Rect bounds = { .x = 0, .y = 0, .w = 1920, .h = 1080 };
+	static Replay replay;
+	if (!session_open(&replay, record_path, replay_path, &bounds)) {
+		return SDL_APP_FAILURE;
+	}
+	if (replay_path != NULL) {
+		tick_count = replay.header.tick_count;
+		if (tick_count < 1) {
+			printf("Nothing to run: the replay is empty\n");
+			return SDL_APP_FAILURE;
+		}
+	}
+	world.replay = replay.file != NULL ? &replay : NULL;
+	if (load_path != NULL) {
+		if (!world_load(&world, load_path)) {
+			return SDL_APP_FAILURE;
+		}
+	} else {
+		init(&bounds, &world.entities, &world.oxygenators, &world.healths, &world.player_controlled, &world.sounds, &world.positions, &world.dimensions, &world.colors, &world.containables, &world.containers, &world.sprites);
+	}
+
+	world.step = NANO_SECONDS_PER_SECOND / SIMULATION_HZ;
+	Uint64* tick_ns = malloc(tick_count * sizeof(Uint64));
+	assert(tick_ns != NULL);
+	Uint64 start = SDL_GetTicksNS();
+	for (long tick = 0; tick < tick_count; tick++) {
+		Uint64 tick_start = SDL_GetTicksNS();
+		world_step_input(&world, 0);
+		world_step(&world);
+		tick_ns[tick] = SDL_GetTicksNS() - tick_start;
+	}
+	Uint64 elapsed = SDL_GetTicksNS() - start;
+
+	qsort(tick_ns, tick_count, sizeof(Uint64), compare_ns);
+	double seconds = (double)elapsed / NANO_SECONDS_PER_SECOND;
+	printf("<HEADLESS> ticks: %ld, workers: %d, entities: %d, simulated: %.2f s, wall: %.3f s\n",
+		tick_count, jobs.worker_count, world.entities.count, (double)tick_count / SIMULATION_HZ, seconds);
+	printf("<HEADLESS> ticks/s: %.1f, tick us: mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+		tick_count / seconds,
+		(double)elapsed / tick_count / 1000.0,
+		tick_ns[tick_count / 2] / 1000.0,
+		tick_ns[tick_count * 99 / 100] / 1000.0,
+		tick_ns[tick_count - 1] / 1000.0);
+	printf("<HEADLESS> checksum: %016llx\n", (unsigned long long)world_checksum(&world));
+	free(tick_ns);
+	replay_close(&replay);
+	if (save_path != NULL) {
+		world_save(&world, save_path);
+	}
+	if (trace_path != NULL) {
+		profile_write_trace(trace_path);
+	}
+	world_free(&world);
+	job_system_free(&jobs);
+	SDL_Quit();
+	return 0;
 }
 
 void cleanup(SDL_Window *p_sdl_window) {
@@ -474,12 +1305,68 @@ void cleanup(SDL_Window *p_sdl_window) {
 	SDL_Quit();
 }
 
-int main() {
+// bench.c includes this file for its systems and brings its own main
+#if !defined(WORLDS_BELOW_NO_MAIN)
+// usage: worlds_below [--threads N] [--trace FILE] [--record FILE | --replay FILE] [--load FILE] [--save FILE]
+//                     [--headless [--ticks N | --seconds S]]
+// --threads is the number of threads running systems, the simulation thread included.
+// --trace names the Chrome trace written on exit; F4 also writes it while playing.
+// --record saves the seed and the input of every step, --replay plays them back
+// instead of the keyboard, and exits when they run out.
+// --load starts from a snapshot instead of spawning a new world. --save names
+// the snapshot F5 writes, or that a headless run writes when it is done.
+int main(int argc, char* argv[]) {
+	bool headless = false;
+	long tick_count = 10 * SIMULATION_HZ;
+	int thread_count = 0;
+	const char* trace_path = NULL;
+	const char* record_path = NULL;
+	const char* replay_path = NULL;
+	const char* load_path = NULL;
+	const char* save_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+			tick_count = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			tick_count = (long)(atof(argv[++i]) * SIMULATION_HZ);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			thread_count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			load_path = argv[++i];
+		} else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+			save_path = argv[++i];
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			return SDL_APP_FAILURE;
+		}
+	}
+	if (record_path != NULL && replay_path != NULL) {
+		printf("--record and --replay exclude each other\n");
+		return SDL_APP_FAILURE;
+	}
+	if (thread_count < 1) {
+		// leave a core to the render thread
+		thread_count = headless ? SDL_GetNumLogicalCPUCores() : SDL_GetNumLogicalCPUCores() - 1;
+	}
+	if (headless) {
+		if (tick_count < 1) {
+			printf("Nothing to run: --ticks and --seconds must be positive\n");
+			return SDL_APP_FAILURE;
+		}
+		return run_headless(tick_count, thread_count, trace_path, record_path, replay_path, load_path, save_path);
+	}
+
 	SDL_Window *p_sdl_window;
 	SDL_Renderer *p_sdl_renderer;
 
-	size_t entityCount = 0;
-
 	if (!SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
 		SDL_Log("Couldn't initialize SDL: %s", SDL_GetError());
 		return SDL_APP_FAILURE;
@@ -493,6 +1380,13 @@ int main() {
 		SDL_Log("Failed to open audio device: %s", SDL_GetError());
 		return SDL_APP_FAILURE;
 	}
+	char* sound_directory = NULL;
+	SDL_asprintf(&sound_directory, "%sresources/", SDL_GetBasePath());
+	bool sound_cache_ready = sound_cache_init(&sound_cache, audio_device, sound_directory);
+	SDL_free(sound_directory);
+	if (!sound_cache_ready || !mixer_init(&mixer, audio_device, &sound_cache.spec)) {
+		return SDL_APP_FAILURE;
+	}
 
 	SDL_Rect displayBounds;
 	SDL_DisplayID primaryDisplayId = SDL_GetPrimaryDisplay();
@@ -506,7 +1400,6 @@ int main() {
 	SDL_CreateWindowAndRenderer("Worlds Below", displayBounds.w, displayBounds.h, SDL_WINDOW_FULLSCREEN, &p_sdl_window, &p_sdl_renderer);
 
 	SDL_Color color = { 255, 255, 255, SDL_ALPHA_OPAQUE };
-	SDL_Surface *text;
 
 	if (!TTF_Init()) {
 		SDL_Log("Couldn't initialise SDL_ttf: %s\n", SDL_GetError());
@@ -520,45 +1413,83 @@ int main() {
 		return SDL_APP_FAILURE;
 	}
 
-	/* Create the text */
-	text = TTF_RenderText_Blended(font, "Hello World!", 0, color);
-	if (text) {
-		texture = SDL_CreateTextureFromSurface(p_sdl_renderer, text);
-		SDL_DestroySurface(text);
+	if (!text_init(&text_renderer, font, p_sdl_renderer)) {
+		return SDL_APP_FAILURE;
 	}
+
+	/* Create the text */
+	texture = text_texture(&text_renderer, p_sdl_renderer, "Hello World!", 18.0f, color);
 	if (!texture) {
 		SDL_Log("Couldn't create text: %s\n", SDL_GetError());
 		return SDL_APP_FAILURE;
 	}
 
 	// components
-	bool player_controlled[MAX_ENTITY_COUNT] = {};
-	// components_v2
-	Containables containables = {0};
-	Containers containers = {0};
-	Colors colors = {0};
-	Dimensions dimensions = {0};
-	Healths healths = {0};
-	Oxygenators oxygenators = {0};
-	Positions positions = {0};
-	Sounds sounds = {0};
-	Sprites sprites = {0};
-
-	init_bmp("o2-tank.bmp", &o2_tank_sprite, p_sdl_renderer);
-
-	init(&displayBounds, &entityCount, &oxygenators, &healths, player_controlled, &sounds, &positions, &dimensions, &colors, &containables, &containers, &sprites);
+	static World world;
+	// render batches, refilled every frame
+	QuadBatch color_batch = {0};
+	QuadBatch profiler_batch = {0};
+	HealthBarCache health_bars = {0};
+
+	char* sprite_directory = NULL;
+	SDL_asprintf(&sprite_directory, "%sresources/", SDL_GetBasePath());
+	if (!sprite_atlas_build(&sprite_atlas, sprite_directory, p_sdl_renderer)) {
+		SDL_Log("Failed to build sprite atlas");
+	}
+	SDL_free(sprite_directory);
+	o2_tank_sprite = sprite_atlas_find(&sprite_atlas, "o2-tank.bmp");
+	if (o2_tank_sprite < 0) {
+		SDL_Log("Missing sprite: o2-tank.bmp");
+	}
+
+	// a replay spawns within the bounds it was recorded with
+	SDL_Rect spawn_bounds = displayBounds;
+	static Replay replay;
+	if (!session_open(&replay, record_path, replay_path, &spawn_bounds)) {
+		return SDL_APP_FAILURE;
+	}
+	world.replay = replay.file != NULL ? &replay : NULL;
+	if (load_path != NULL) {
+		if (!world_load(&world, load_path)) {
+			return SDL_APP_FAILURE;
+		}
+	} else {
+		init(&spawn_bounds, &world.entities, &world.oxygenators, &world.healths, &world.player_controlled, &world.sounds, &world.positions, &world.dimensions, &world.colors, &world.containables, &world.containers, &world.sprites);
+	}
+	world.save_path = save_path != NULL ? save_path : "worlds_below.snapshot";
 	enum GameState game_state = RUNNING;
 
-	add_Sounds(&sounds, entityCount, (c_sound){ fname: "background-music.wav", repeat: true });
-	c_sound* background_sound = get_Sounds(&sounds, entityCount);
-	if (!init_sound(background_sound)) {
-		SDL_Log("Failed to initialize sound: %s", SDL_GetError());
+	// a loaded world keeps the music's entity, but not the sound playing on it
+	if (world.background_music.count == 0) {
+		add_BackgroundMusic(&world.background_music, create_entity(&world.entities));
+	}
+	Query music_query = QUERY(&world.background_music);
+	while (query_next(&music_query)) {
+		add_Sounds(&world.sounds, music_query.entity, (c_sound){ fname: "background-music.wav", repeat: true, streamed: true, priority: 1 });
+		c_sound* background_sound = get_Sounds(&world.sounds, music_query.entity);
+		if (!init_sound(background_sound)) {
+			SDL_Log("Failed to initialize sound: %s", SDL_GetError());
+		}
 	}
 
-	bool player_left = false;
-	bool player_right = false;
-	bool player_up = false;
-	bool player_down = false;
+	// the simulation thread is worker 0 of the pool running its systems
+	static JobSystem jobs;
+	if (!job_system_init(&jobs, thread_count - 1)) {
+		return SDL_APP_FAILURE;
+	}
+	world_init(&world, &jobs);
+
+	// from here on the pools belong to the simulation thread
+	triple_buffer_init(&world.snapshot_buffer);
+	SDL_SetAtomicInt(&world.running, 1);
+	SDL_SetAtomicInt(&world.game_state, game_state);
+	SDL_Thread* simulation_thread = SDL_CreateThread(simulate, "simulation", &world);
+	if (simulation_thread == NULL) {
+		SDL_Log("Couldn't start the simulation thread: %s", SDL_GetError());
+		return SDL_APP_FAILURE;
+	}
+
+	int input = 0;
 
 	struct timespec start, end;
 	long time_since_last_tick = 0;
@@ -572,22 +1503,108 @@ int main() {
 	const float scale = 2.0f;
 
 	bool running = true;
+	bool show_profiler = false;
+	profile_thread("render");
+	arena_init(&frame_arena, FRAME_ARENA_SIZE);
 	while(running) {
+		arena_reset(&frame_arena);
+		profile_frame();
 		timespec_get(&end, TIME_UTC);
 		time_since_last_tick = ((end.tv_sec - start.tv_sec) * NANO_SECONDS_PER_SECOND ) + (end.tv_nsec - start.tv_nsec);
 		timespec_get(&start, TIME_UTC);
 		//printf("NS SINCE LAST TICK: %ld\n", time_since_last_tick);
 
-		SDL_SetRenderDrawColor(p_sdl_renderer, 0, 0, 20, 0x00);
-		SDL_RenderClear(p_sdl_renderer);
-
+		ProfileScope events_scope = profile_begin("events");
+		SDL_Event event;
+		while(SDL_PollEvent(&event)) {
+			switch(event.type) {
+				case SDL_EVENT_KEY_DOWN: 
+					// TODO: add proper logging with levels like trace/debug
+					// printf("detected a keyboard event. %d\n", event.key.key);
+					switch(event.key.key) {
+						case SDLK_Q:
+							running = false;
+							break;
+						case SDLK_LEFT:
+							printf("LEFT\n");
+							input |= INPUT_LEFT;
+							break;
+						case SDLK_RIGHT:
+							printf("RIGHT\n");
+							input |= INPUT_RIGHT;
+							break;
+						case SDLK_UP:
+							printf("UP\n");
+							input |= INPUT_UP;
+							break;
+						case SDLK_DOWN:
+							printf("DOWN\n");
+							input |= INPUT_DOWN;
+							break;
+						case SDLK_ESCAPE:
+							if (game_state == RUNNING) {
+								game_state = PAUSED;
+							} else if (game_state == PAUSED) {
+								game_state = RUNNING;
+							}
+							break;
+						case SDLK_F3:
+							show_profiler = !show_profiler;
+							break;
+						case SDLK_F4:
+							profile_write_trace(trace_path != NULL ? trace_path : "worlds_below_trace.json");
+							break;
+						case SDLK_F5:
+							SDL_SetAtomicInt(&world.save_requested, 1);
+							break;
+					}
+					break;
+				case SDL_EVENT_KEY_UP: 
+					// TODO: add proper logging with levels like trace/debug
+					switch(event.key.key) {
+						case SDLK_LEFT:
+							input &= ~INPUT_LEFT;
+							break;
+						case SDLK_RIGHT:
+							input &= ~INPUT_RIGHT;
+							break;
+						case SDLK_UP:
+							input &= ~INPUT_UP;
+							break;
+						case SDLK_DOWN:
+							input &= ~INPUT_DOWN;
+							break;
+					}
+					break;
+				case SDL_EVENT_QUIT:
+					printf("detected a quit event.\n");
+					running = false;
+					break;
+				default: 
+					printf("detected an unhandled event.\n");
+					break;
+			}
+		}
+		profile_end(&events_scope);
+		SDL_SetAtomicInt(&world.input, input);
+		SDL_SetAtomicInt(&world.game_state, game_state);
 
+		RenderSnapshot* snapshot = &world.snapshots[triple_buffer_acquire(&world.snapshot_buffer)];
+		float alpha = snapshot_alpha(snapshot);
 
+		SDL_SetRenderDrawColor(p_sdl_renderer, 0, 0, 20, 0x00);
+		SDL_RenderClear(p_sdl_renderer);
 
 		SDL_SetRenderScale(p_sdl_renderer, 1.0, 1.0);
-		sys_position_dimension_color(&positions, &dimensions, &colors, p_sdl_renderer);
-		sys_position_dimension_sprite(&positions, &dimensions, &sprites, p_sdl_renderer);
-		sys_health_dimension_position(&healths, &positions, &dimensions, p_sdl_renderer);
+		ProfileScope render_scope = profile_begin("render colors");
+		render_colors(snapshot, alpha, &color_batch, p_sdl_renderer);
+		profile_end(&render_scope);
+		render_scope = profile_begin("render sprites");
+		render_sprites(snapshot, alpha, &sprite_atlas, p_sdl_renderer);
+		profile_end(&render_scope);
+		render_scope = profile_begin("render health bars");
+		render_health_bars(snapshot, alpha, &health_bars, p_sdl_renderer);
+		profile_end(&render_scope);
 
 		/* Center the text and scale it up */
 		SDL_GetRenderOutputSize(p_sdl_renderer, &w, &h);
@@ -597,83 +1614,14 @@ int main() {
 		dst.y = ((h / scale) - dst.h) / 2;
 		SDL_SetRenderScale(p_sdl_renderer, 1.0, 1.0);
 
-		sys_sound(&sounds);
-
 		switch(game_state) {
 
 			case RUNNING: {
-					      update_player(&time_since_last_tick, &entityCount, player_controlled, &positions, player_left, player_right, player_up, player_down);
-					      sys_health_oxygenator_position_dimension_sound(&time_since_last_tick, &entityCount, &healths, &oxygenators, &positions, &dimensions, &sounds);
-					      sys_containables_container_position_dimension_sound(&containables, &containers, &positions, &dimensions, &sounds);
-
-					      SDL_Event event;
-					      while(SDL_PollEvent(&event)) {
-						      switch(event.type) {
-							      case SDL_EVENT_KEY_DOWN: 
-								      // TODO: add proper logging with levels like trace/debug
-								      // printf("detected a keyboard event. %d\n", event.key.key);
-								      switch(event.key.key) {
-									      case SDLK_Q:
-										      running = false;
-										      break;
-									      case SDLK_LEFT:
-										      printf("LEFT\n");
-										      player_left = true;
-										      break;
-									      case SDLK_RIGHT:
-										      printf("RIGHT\n");
-										      player_right = true;
-										      break;
-									      case SDLK_UP:
-										      printf("UP\n");
-										      player_up = true;
-										      break;
-									      case SDLK_DOWN:
-										      printf("DOWN\n");
-										      player_down = true;
-										      break;
-									      case SDLK_ESCAPE:
-										      game_state = PAUSED;
-										      break;
-								      }
-								      break;
-							      case SDL_EVENT_KEY_UP: 
-								      // TODO: add proper logging with levels like trace/debug
-								      switch(event.key.key) {
-									      case SDLK_LEFT:
-										      player_left = false;
-										      break;
-									      case SDLK_RIGHT:
-										      player_right = false;
-										      break;
-									      case SDLK_UP:
-										      player_up = false;
-										      break;
-									      case SDLK_DOWN:
-										      player_down = false;
-										      break;
-								      }
-								      break;
-							      case SDL_EVENT_QUIT:
-								      printf("detected a quit event.\n");
-								      running = false;
-								      break;
-							      default: 
-								      printf("detected an unhandled event.\n");
-								      break;
-						      }
-					      }
 					      break;
 				      }
 			case PAUSED: {
-					     /* Create the text */
-					     SDL_Texture *pause_text_texture = NULL;
-					     SDL_Surface *pause_text;
-					     pause_text = TTF_RenderText_Blended(font, "PAUSED", 0, color);
-					     if (pause_text) {
-						     pause_text_texture = SDL_CreateTextureFromSurface(p_sdl_renderer, pause_text);
-						     SDL_DestroySurface(text);
-					     }
+					     /* Create the text once, then reuse it */
+					     SDL_Texture *pause_text_texture = text_texture(&text_renderer, p_sdl_renderer, "PAUSED", 18.0f, color);
 					     if (!pause_text_texture) {
 						     SDL_Log("Couldn't create text: %s\n", SDL_GetError());
 						     return SDL_APP_FAILURE;
@@ -685,34 +1633,12 @@ int main() {
 					     dst.x = ((w / scale) - dst.w) / 2;
 					     dst.y = ((h / scale) - dst.h) / 2;
 					     SDL_RenderTexture(p_sdl_renderer, pause_text_texture, NULL, &dst);
-
-					     SDL_Event event;
-					     while(SDL_PollEvent(&event)) {
-						     switch(event.type) {
-							     case SDL_EVENT_KEY_DOWN: 
-								     // TODO: add proper logging with levels like trace/debug
-								     // printf("detected a keyboard event. %d\n", event.key.key);
-								     switch(event.key.key) {
-									     case SDLK_ESCAPE:
-										     game_state = RUNNING;
-										     break;
-									     case SDLK_Q:
-										     running = false;
-										     break;
-								     }
-						     }
-					     }
+					     SDL_SetRenderScale(p_sdl_renderer, 1.0, 1.0);
 					     break;
 				     }
 			case LOST: {
-					   /* Create the text */
-					   SDL_Texture *lost_text_texture = NULL;
-					   SDL_Surface *lost_text;
-					   lost_text = TTF_RenderText_Blended(font, "LOST", 0, color);
-					   if (lost_text) {
-						   lost_text_texture = SDL_CreateTextureFromSurface(p_sdl_renderer, lost_text);
-						   SDL_DestroySurface(text);
-					   }
+					   /* Create the text once, then reuse it */
+					   SDL_Texture *lost_text_texture = text_texture(&text_renderer, p_sdl_renderer, "LOST", 18.0f, color);
 					   if (!lost_text_texture) {
 						   SDL_Log("Couldn't create text: %s\n", SDL_GetError());
 						   return SDL_APP_FAILURE;
@@ -732,23 +1658,40 @@ int main() {
 			time_since_last_fps_calc = 0;
 		}
 
-		int length = snprintf(NULL, 0, "FPS: %u", fps);
-		char* str = malloc(length + 1);
-		snprintf(str, length + 1, "FPS: %u", fps);
+		char* str = arena_printf(&frame_arena, "FPS: %u", fps);
+		char* entityCountStr = arena_printf(&frame_arena, "ENTITY_COUNT: %d", snapshot->entity_count);
 
-		int entityCountLength = snprintf(NULL, 0, "ENTITY COUNT: %zu", entityCount);
-		char* entityCountStr = malloc(entityCountLength + 1);
-		snprintf(entityCountStr, entityCountLength + 1, "ENTITY_COUNT: %zu", entityCount);
-
-		SDL_SetRenderDrawColor(p_sdl_renderer, 255, 0, 255, SDL_ALPHA_OPAQUE);
-		SDL_RenderDebugText(p_sdl_renderer, 10, 10, str);
-		SDL_RenderDebugText(p_sdl_renderer, 10, 20, entityCountStr);
+		const SDL_FColor hud_color = { 1.0f, 0.0f, 1.0f, 1.0f };
+		text_draw(&text_renderer, str, 10, 10, hud_color);
+		text_draw(&text_renderer, entityCountStr, 10, 10 + text_renderer.line_height, hud_color);
+		if (show_profiler) {
+			render_profiler(&text_renderer, &profiler_batch, &frame_arena, 10, 10 + 3 * text_renderer.line_height, p_sdl_renderer);
+		}
+		text_flush(&text_renderer, p_sdl_renderer);
+		ProfileScope present_scope = profile_begin("present");
 		SDL_RenderPresent(p_sdl_renderer);
+		profile_end(&present_scope);
 
 	}
+	SDL_SetAtomicInt(&world.running, 0);
+	SDL_WaitThread(simulation_thread, NULL);
+	replay_close(&replay);
+	if (trace_path != NULL) {
+		profile_write_trace(trace_path);
+	}
+	job_system_free(&jobs);
+	world_free(&world);
+	arena_free(&frame_arena);
+	quad_batch_free(&color_batch);
+	quad_batch_free(&profiler_batch);
+	text_free(&text_renderer);
+	sprite_atlas_free(&sprite_atlas);
+	mixer_free(&mixer);
+	sound_cache_free(&sound_cache);
 	cleanup(p_sdl_window);
 	return 0;
 }
+#endif // WORLDS_BELOW_NO_MAIN
 
 /* license.txt
    Copyright (C) 2004 by Matthew Welch